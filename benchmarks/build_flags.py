@@ -0,0 +1,82 @@
+"""
+Compare the speed of two builds of classylss, e.g. the default build and
+one with ``CLASSYLSS_MARCH=native CLASSYLSS_LTO=1``.
+
+Run this once in each environment, saving the timings, then compare::
+
+    python benchmarks/build_flags.py --save default.json
+    CLASSYLSS_MARCH=native CLASSYLSS_LTO=1 pip install . --no-build-isolation
+    python benchmarks/build_flags.py --save native.json --compare default.json
+
+The timings are the best of ``--repeat`` runs, in seconds.
+"""
+import argparse
+import json
+import time
+
+import numpy
+
+from classylss.binding import ClassEngine, Background, Spectra
+
+# a high precision matter power spectrum, dominated by perturb_init
+PARS = {'output': 'mPk dTk', 'P_k_max_h/Mpc': 50., 'z_max_pk': 10.,
+        'k_per_decade_for_pk': 50, 'l_max_g': 30, 'l_max_pol_g': 30,
+        'l_max_ur': 40}
+
+def best(func, repeat):
+    r = []
+    for i in range(repeat):
+        t0 = time.perf_counter()
+        func()
+        r.append(time.perf_counter() - t0)
+    return min(r)
+
+def run(repeat, nthreads):
+    timings = {}
+
+    def compute():
+        engine = ClassEngine(PARS, nthreads=nthreads)
+        Spectra(engine).get_pk(0.1, 0.)
+
+    timings['compute'] = best(compute, repeat)
+
+    engine = ClassEngine(PARS, nthreads=nthreads)
+    ba = Background(engine, nthreads=1)
+    sp = Spectra(engine)
+
+    z = numpy.random.uniform(0, 10, size=1000000)
+    timings['comoving_distance'] = best(lambda: ba.comoving_distance(z), repeat)
+
+    k = numpy.logspace(-3, 1, 100000)
+    timings['get_pk'] = best(lambda: sp.get_pk(k, 1.), repeat)
+    timings['get_transfer'] = best(lambda: sp.get_transfer(numpy.linspace(0, 5, 16)), repeat)
+
+    return timings
+
+def main(args=None):
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('--repeat', type=int, default=5)
+    parser.add_argument('--nthreads', type=int, default=None,
+                        help='the OpenMP threads of the CLASS modules')
+    parser.add_argument('--save', help='save the timings to this JSON file')
+    parser.add_argument('--compare', help='the JSON file of the reference build')
+    ns = parser.parse_args(args)
+
+    timings = run(ns.repeat, ns.nthreads)
+    reference = None
+    if ns.compare:
+        with open(ns.compare) as ff:
+            reference = json.load(ff)
+
+    for name in timings:
+        line = '%-20s %10.4f s' % (name, timings[name])
+        if reference is not None and name in reference:
+            line += '   speedup %.2fx' % (reference[name] / timings[name])
+        print(line)
+
+    if ns.save:
+        with open(ns.save, 'w') as ff:
+            json.dump(timings, ff, indent=2)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,33 @@
+"""
+Benchmarks of classylss, with pytest-benchmark; run with
+
+    python run-tests.py --bench
+
+The results are saved in ``benchmarks/.results`` with the version of
+classylss, so that they can be compared across versions with
+``pytest-benchmark compare``.
+"""
+import os
+import pytest
+
+pytest.importorskip('pytest_benchmark')
+
+# the largest number of points of the accessor benchmarks
+MAX_SIZE = int(float(os.environ.get('CLASSYLSS_BENCH_MAX_SIZE', 1e7)))
+
+PARS = {'output': 'mPk dTk', 'P_k_max_h/Mpc': 20., 'z_max_pk': 10.}
+
+def sizes(*values):
+    return [int(v) for v in values if v <= MAX_SIZE]
+
+def pytest_benchmark_update_json(config, benchmarks, output_json):
+    import classylss
+    output_json['classylss'] = {'version': classylss.__version__,
+                                'class_version': classylss.class_version}
+
+@pytest.fixture(scope='module')
+def engine():
+    from classylss.binding import ClassEngine
+    engine = ClassEngine(PARS)
+    engine.compute('lensing')
+    return engine
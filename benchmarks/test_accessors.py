@@ -0,0 +1,56 @@
+import numpy
+import pytest
+from classylss.binding import Background, FastBackground, Spectra
+
+from conftest import sizes
+
+@pytest.mark.parametrize("size", sizes(1e3, 1e5, 1e7))
+def test_comoving_distance(benchmark, engine, size):
+    ba = Background(engine)
+    z = numpy.random.uniform(0., 10., size=size)
+    benchmark(ba.comoving_distance, z)
+
+@pytest.mark.parametrize("size", sizes(1e3, 1e5, 1e7))
+def test_comoving_distance_sorted(benchmark, engine, size):
+    ba = Background(engine)
+    z = numpy.linspace(0., 10., size)
+    benchmark(ba.comoving_distance, z)
+
+@pytest.mark.parametrize("size", sizes(1e3, 1e5, 1e7))
+def test_evaluate(benchmark, engine, size):
+    ba = Background(engine)
+    z = numpy.random.uniform(0., 10., size=size)
+    benchmark(ba.evaluate, z, ['H', 'conf_distance'])
+
+@pytest.mark.parametrize("size", sizes(1e3, 1e5, 1e7))
+def test_fast_background(benchmark, engine, size):
+    fb = FastBackground(Background(engine), z_max=10.)
+    z = numpy.random.uniform(0., 10., size=size)
+    benchmark(fb.comoving_distance, z)
+
+@pytest.mark.parametrize("linear", [True, False])
+@pytest.mark.parametrize("size", sizes(1e3, 1e5, 1e7))
+def test_get_pk(benchmark, engine, size, linear):
+    sp = Spectra(engine)
+    k = numpy.logspace(-3, 1, size)
+    func = sp.get_pklin if linear else sp.get_pk
+    benchmark(func, k, 1.)
+
+@pytest.mark.parametrize("size", sizes(1e3, 1e5, 1e7))
+def test_pk_interpolator(benchmark, engine, size):
+    pk = Spectra(engine).get_pk_interpolator()
+    k = numpy.logspace(-3, 1, size)
+    z = numpy.random.uniform(0., 10., size=size)
+    benchmark(pk, k, z)
+
+@pytest.mark.parametrize("size", sizes(1e3, 1e5))
+def test_sigma8_z(benchmark, engine, size):
+    sp = Spectra(engine)
+    z = numpy.random.uniform(0., 10., size=size)
+    benchmark(sp.sigma8_z, z)
+
+@pytest.mark.parametrize("size", sizes(1e1, 1e3))
+def test_get_transfer(benchmark, engine, size):
+    sp = Spectra(engine)
+    z = numpy.random.uniform(0., 10., size=size)
+    benchmark(sp.get_transfer, z)
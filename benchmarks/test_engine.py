@@ -0,0 +1,27 @@
+import pytest
+from classylss.binding import ClassEngine
+
+from conftest import PARS
+
+LEVELS = ["background", "thermodynamics", "perturb", "primordial",
+          "nonlinear", "transfer", "spectra", "lensing"]
+
+def test_construction(benchmark):
+    benchmark(ClassEngine, PARS)
+
+@pytest.mark.parametrize("level", LEVELS)
+def test_compute(benchmark, level):
+    # from the input up to level
+    def setup():
+        return (ClassEngine(PARS),), {}
+    benchmark.pedantic(lambda engine: engine.compute(level), setup=setup, rounds=3)
+
+@pytest.mark.parametrize("level", LEVELS)
+def test_module(benchmark, level):
+    # only the init of the module, with the previous ones computed
+    previous = (["input"] + LEVELS)[LEVELS.index(level)]
+    def setup():
+        engine = ClassEngine(PARS)
+        engine.compute(previous)
+        return (engine,), {}
+    benchmark.pedantic(lambda engine: engine.compute(level), setup=setup, rounds=3)
@@ -16,6 +16,35 @@ def get_data_files():
     )
     return r
 
+def set_num_threads(nthreads):
+    """
+    Set the default number of threads used by the vectorized accessors of
+    :mod:`classylss.binding`; see :func:`classylss.binding.set_num_threads`.
+    The threads of the CLASS modules are set per engine, with the
+    ``nthreads`` argument of :class:`~classylss.binding.ClassEngine`.
+    """
+    from .binding import set_num_threads
+    set_num_threads(nthreads)
+
+def set_float32_results(enabled):
+    """
+    Enable or disable the float32 results of the vectorized accessors for
+    float32 inputs; see :func:`classylss.binding.set_float32_results`.
+    """
+    from .binding import set_float32_results
+    set_float32_results(enabled)
+
+def get_include():
+    """
+    Returns the directories of the CLASS and numpy headers, which are needed
+    to compile Cython extensions that cimport :mod:`classylss.binding`.
+    """
+    import os
+    import numpy
+
+    path = os.path.join(os.path.dirname(__file__), 'include')
+    return [path, numpy.get_include()]
+
 def _find_file(filename):
     """
     Find the file path, first checking if it exists and then looking in the
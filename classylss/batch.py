@@ -0,0 +1,244 @@
+"""
+Run CLASS for many sets of parameters concurrently.
+
+:class:`~classylss.binding.ClassEngine` releases the GIL while the CLASS
+modules are initialized, so independent engines can be computed from a
+pool of threads in the same process. This is only done if the CLASS
+library has no writable global data besides the symbols reviewed in
+``depends/globals.reviewed``, as checked when it is built; otherwise the
+engines are computed one at a time.
+"""
+import os
+import threading
+import warnings
+import numpy
+
+_lock = threading.Lock()
+_unreviewed = []
+
+def unreviewed_globals():
+    """
+    Return the writable global symbols of the CLASS library that are not
+    reviewed as safe to share between threads, as ``(object, symbol)``
+    pairs, or None if the build did not record them.
+    """
+    if not _unreviewed:
+        path = os.path.join(os.path.dirname(__file__), 'data', 'globals.unreviewed')
+        symbols = None
+        if os.path.exists(path):
+            with open(path, 'r') as ff:
+                symbols = [tuple(line.split()[:2]) for line in ff if len(line.split()) >= 2]
+        _unreviewed.append(symbols)
+    return _unreviewed[0]
+
+class _Unlocked(object):
+    def __enter__(self):
+        return self
+    def __exit__(self, *args):
+        return False
+
+def _guard():
+    """
+    The lock held while computing an engine: a lock shared by all the
+    threads if the CLASS library may have unsafe global data, else none.
+    """
+    if unreviewed_globals() == []:
+        return _Unlocked()
+    return _lock
+
+def run_many(pars, outputs, nthreads=None, engine_nthreads=1):
+    """
+    Compute a list of cosmologies concurrently, evaluating ``outputs``
+    on each of them.
+
+    A failure in one cosmology does not abort the batch; the exception is
+    returned in ``errors`` at the same position instead.
+
+    Parameters
+    ----------
+    pars : list of dict
+        the CLASS parameters of each cosmology
+    outputs : callable or dict of callables
+        functions taking a :class:`~classylss.binding.ClassEngine` and
+        returning the requested quantities, e.g.
+        ``lambda engine: Spectra(engine).get_pk(k, 0.)``
+    nthreads : int, optional
+        the number of cosmologies computed at the same time; default is
+        the number of CPUs. If :func:`unreviewed_globals` is not empty,
+        the cosmologies are computed one at a time, with a warning.
+    engine_nthreads : int, optional
+        the number of OpenMP threads of the CLASS modules of each
+        cosmology; None for the OpenMP default. The default of 1 avoids
+        oversubscribing the CPUs when ``nthreads`` is large.
+
+    Returns
+    -------
+    results : list
+        the value of ``outputs`` (or a dict with the same keys as
+        ``outputs``) for each cosmology; None if it failed
+    errors : list
+        the exception raised by each cosmology, or None if it succeeded
+    """
+    from multiprocessing.pool import ThreadPool
+    from .binding import ClassEngine
+
+    if isinstance(outputs, dict):
+        for name in outputs:
+            if not callable(outputs[name]):
+                raise TypeError("output '%s' is not callable" % name)
+    elif not callable(outputs):
+        raise TypeError("outputs must be a callable or a dict of callables")
+
+    if nthreads is not None and nthreads < 1:
+        raise ValueError("nthreads must be positive")
+
+    unsafe = unreviewed_globals()
+    if unsafe != [] and nthreads != 1:
+        if unsafe is None:
+            reason = "were not checked by the build"
+        else:
+            reason = "include unreviewed symbols (%s)" % ', '.join(s for o, s in unsafe)
+        warnings.warn("the writable globals of the CLASS library %s; the cosmologies are "
+                      "computed one at a time" % reason)
+
+    def run(p):
+        try:
+            with _guard():
+                engine = ClassEngine(p, nthreads=engine_nthreads)
+                if isinstance(outputs, dict):
+                    r = dict((name, outputs[name](engine)) for name in outputs)
+                else:
+                    r = outputs(engine)
+            return r, None
+        except Exception as e:
+            return None, e
+
+    pool = ThreadPool(nthreads)
+    try:
+        r = pool.map(run, list(pars), chunksize=1)
+    finally:
+        pool.close()
+        pool.join()
+
+    results = [x[0] for x in r]
+    errors = [x[1] for x in r]
+    return results, errors
+
+def _observables(engine, k, z, linear):
+    from .binding import Background, Spectra
+
+    # in units without h, so that h can be varied
+    ba = Background(engine)
+    h = ba.h
+    r = {}
+    if k is not None:
+        sp = Spectra(engine)
+        kk, zz = k[:, None] / h, z[None, :]
+        r['pk'] = (sp.get_pklin(kk, zz) if linear else sp.get_pk(kk, zz)) / h ** 3
+    r['D_A'] = ba.angular_diameter_distance(z) / h
+    r['H'] = ba.hubble_function(z) * ba.C
+    return r
+
+def derivatives(pars, steps, z, k=None, linear=False, nthreads=None, engine_nthreads=1):
+    r"""
+    The derivatives of the power spectrum, the angular diameter distance and
+    the Hubble rate with respect to some parameters, by central finite
+    differences, e.g. for Fisher forecasts.
+
+    The parameters that only affect the primordial or the nonlinear
+    modules (e.g. ``A_s``, ``n_s``) are varied on the fiducial engine
+    with :func:`ClassEngine.update`, which recomputes only these modules;
+    for the other parameters, the engines of :math:`\theta \pm h` are
+    computed concurrently, as in :func:`run_many`.
+
+    Parameters
+    ----------
+    pars : dict
+        the fiducial CLASS parameters, including the varied ones
+    steps : dict
+        the absolute step :math:`h` of each varied parameter; the
+        derivatives are :math:`[f(\theta + h) - f(\theta - h)] / 2h`
+    z : array_like
+        the redshifts
+    k : array_like, optional
+        the wavenumbers of the power spectrum in :math:`\mathrm{Mpc}^{-1}`,
+        without :math:`h`, so that the grid does not move with ``h``; if
+        not given, the power spectrum is not computed
+    linear : bool, optional
+        whether to use the linear power spectrum even if the nonlinear
+        power is enabled
+    nthreads : int, optional
+        the number of engines computed at the same time; default is the
+        number of CPUs
+    engine_nthreads : int, optional
+        the number of OpenMP threads of each engine; see :func:`run_many`
+
+    Returns
+    -------
+    names : list of str
+        the varied parameters, in the order of the first axis of the
+        derivatives
+    derivatives : dict
+        the derivatives stacked along the first axis: ``'pk'`` of shape
+        ``(len(names), len(k), len(z))`` in :math:`\mathrm{Mpc}^3`,
+        ``'D_A'`` in Mpc and ``'H'`` in km/s/Mpc, of shape
+        ``(len(names), len(z))``; ``'fiducial'`` holds the values of the
+        fiducial cosmology
+    """
+    from concurrent.futures import ThreadPoolExecutor
+    from .binding import ClassEngine, _first_affected_module
+
+    names = list(steps)
+    for name in names:
+        if name not in pars:
+            raise ValueError("the fiducial value of '%s' is not in pars" % name)
+        if not steps[name] > 0:
+            raise ValueError("the step of '%s' must be positive" % name)
+
+    z = numpy.atleast_1d(numpy.asarray(z, dtype='f8'))
+    if k is not None:
+        k = numpy.atleast_1d(numpy.asarray(k, dtype='f8'))
+    outputs = lambda engine: _observables(engine, k, z, linear)
+
+    def shifted(name, sign):
+        p = dict(pars)
+        p[name] = float(pars[name]) + sign * steps[name]
+        return p
+
+    # the parameters that do not affect the background and perturbations
+    cheap = [name for name in names if _first_affected_module([name]) != "input"]
+    full = [name for name in names if name not in cheap]
+
+    def run_cheap():
+        with _guard():
+            engine = ClassEngine(pars, nthreads=engine_nthreads)
+            r = {'fiducial': outputs(engine)}
+            for name in cheap:
+                for sign in [1, -1]:
+                    # the other parameters are set back to their fiducial value
+                    engine.update(shifted(name, sign))
+                    r[name, sign] = outputs(engine)
+        return r
+
+    executor = ThreadPoolExecutor(1)
+    try:
+        future = executor.submit(run_cheap)
+        shifts = [(name, sign) for name in full for sign in [1, -1]]
+        results, errors = run_many([shifted(name, sign) for name, sign in shifts], outputs,
+                                   nthreads=nthreads, engine_nthreads=engine_nthreads)
+        r = future.result()
+    finally:
+        executor.shutdown()
+
+    for (name, sign), e in zip(shifts, errors):
+        if e is not None:
+            raise ValueError("computing the cosmology of %s = %s failed: %s"
+                             % (name, shifted(name, sign)[name], e))
+    r.update(zip(shifts, results))
+
+    fiducial = r['fiducial']
+    derivs = {'fiducial': fiducial}
+    for key in fiducial:
+        derivs[key] = numpy.array([(r[name, 1][key] - r[name, -1][key]) / (2 * steps[name])
+                                   for name in names]).reshape((len(names),) + fiducial[key].shape)
+    return names, derivs
@@ -0,0 +1,234 @@
+# Declarations of the extension types of classylss.binding that can be used
+# from other Cython modules, with e.g.
+#
+#   from classylss.binding cimport Background, Spectra, PowerSpectrumInterpolator
+#
+# The public cdef methods declared here are nogil, so they can be called in
+# the parallel loops of other extensions:
+#
+#   Background.column_at_z    a column of the background vector at z
+#   Background.growth_at_z    the growth factor and growth rate at z
+#   Spectra.pk_at_k_and_z     the power spectrum at (k, z)
+#   PowerSpectrumInterpolator.evaluate / evaluate_many
+#
+# They return _SUCCESS_ or _FAILURE_; on failure the reason is left in the
+# error_message of the CLASS structure of the wrapper. The methods starting
+# with an underscore are internal.
+
+cimport numpy as np
+from classylss.cclassy cimport *
+
+ctypedef struct ready_flags:
+    int fc
+    int ba
+    int th
+    int pt
+    int pm
+    int nl
+    int tr
+    int sp
+    int op
+    int le
+    int input
+
+cdef class ClassEngine:
+    cdef precision pr
+    cdef background ba
+    cdef thermo th
+    cdef perturbs pt
+    cdef primordial pm
+    cdef nonlinear nl
+    cdef transfers tr
+    cdef spectra sp
+    cdef output op
+    cdef lensing le
+    cdef ready_flags ready
+    cdef file_content fc
+    cdef object _lock
+    cdef readonly dict pars
+    # The number of OpenMP threads of the CLASS modules; 0 means the OpenMP
+    # default.
+    cdef public int nthreads
+    # The instrumentation of the modules computed by compute.
+    cdef readonly dict timings
+    cdef readonly dict memory
+    cdef public object trace
+    cdef set _released
+    # The ComputeFuture of the running compute_async, if any.
+    cdef object _request
+    # The number of live table views of each module; see _table_view.
+    cdef dict _views
+    # The depth of the computations running under the lock.
+    cdef int _computing
+    # Objects built from the tables of a module, e.g. the interpolator of
+    # Spectra.sigma, keyed by (module, name); dropped when it is freed.
+    cdef dict _derived
+
+    cdef _update(self, dict pars, start, level)
+    cdef _free_modules(self, start)
+    cdef _drop_derived(self, modules)
+    cdef _check_views(self, modules)
+    cpdef compute(self, level)
+    cdef _locked_compute(self, level, request)
+    cdef _check_not_computing(self)
+    cdef int require(self, const char * level, char * error_message) nogil
+    cdef int _is_ready(self, level) except -1
+    cdef _compute(self, level)
+    cdef _begin(self, module)
+    cdef _end(self, module, int status)
+    cdef dict _module_memory(self, module)
+
+cdef class ParameterTemplate:
+    cdef file_content fc
+    cdef int _ready
+    cdef dict _index
+    cdef readonly dict pars
+    cdef readonly tuple varying
+
+    cdef _stamp(self, file_content * fc, dict values)
+
+cdef class Background:
+    cdef ClassEngine engine
+    cdef background * ba
+    cdef readonly dict data
+    # The number of threads used by compute_for_z; 0 means the default set
+    # by set_num_threads.
+    cdef public int nthreads
+
+    # Current Hubble parameter in units of km/s (Mpc/h)^{-1}.
+    cdef readonly double H0
+    # The speed of light in units of km/s.
+    cdef readonly double C
+    # The gravitational constant in units of
+    # 10^{-10} (Msun/h)^{-1} (Mpc/h) km^2 s^{-2}.
+    cdef readonly double G
+
+    cdef int column_at_z(self, double z, int column, double * value) nogil
+    cdef int growth_at_z(self, double z, double * D, double * f) nogil
+    cdef int _vector_at_z(self, double z, double * pvecback) nogil
+    cdef int _compute_for_z(self, const double * z, Py_ssize_t zstride, Py_ssize_t size,
+                            const int * columns, int ncolumns,
+                            double * out, Py_ssize_t ostride, double scale,
+                            int monotonic, int nthreads) nogil
+
+cdef class FastBackground:
+    # The dimensionless Hubble parameter.
+    cdef readonly double h
+    # The Hubble parameter today, in CLASS units.
+    cdef readonly double H0
+    # The range of redshifts of the tables.
+    cdef readonly double z_min
+    cdef readonly double z_max
+    # The number of nodes of the tables.
+    cdef readonly Py_ssize_t size
+    # The tabulated quantities, of shape (5, size), in the units of the
+    # corresponding methods.
+    cdef readonly np.ndarray table
+    # ln(1+z) tabulated on a uniform grid in comoving distance.
+    cdef readonly np.ndarray inverse
+    # The number of threads used by the evaluation; 0 means the default set
+    # by set_num_threads.
+    cdef public int nthreads
+
+    cdef np.ndarray table2
+    cdef np.ndarray inverse2
+    cdef double * _table
+    cdef double * _table2
+    cdef double * _inverse
+    cdef double * _inverse2
+
+    # uniform grid in ln a and in comoving distance
+    cdef double x0, dx
+    cdef double d0, dd
+
+    cdef _set_tables(self, np.ndarray table, np.ndarray table2,
+                     np.ndarray inverse, np.ndarray inverse2)
+    cdef _setup_forward(self, double x0, double dx, np.ndarray table)
+    cdef _setup_inverse(self)
+    cdef Py_ssize_t _evaluate_many(self, const double * x, Py_ssize_t xstride, Py_ssize_t size,
+                                   int column, double * out, Py_ssize_t ostride, int nthreads) nogil
+
+cdef class Perturbs:
+    cdef ClassEngine engine
+    cdef perturbs * pt
+    cdef background * ba
+
+cdef class Thermo:
+    cdef ClassEngine engine
+    cdef thermo * th
+    cdef background * ba
+    # The number of threads used by compute_for_z; 0 means the default set
+    # by set_num_threads.
+    cdef public int nthreads
+    # The wrapper of the background of the engine, made by sound_horizon.
+    cdef Background _background
+
+    cdef int _compute_for_z(self, const double * z, Py_ssize_t zstride, Py_ssize_t size,
+                            const int * columns, int ncolumns,
+                            double * out, Py_ssize_t ostride, double scale,
+                            int monotonic, int nthreads) nogil
+
+cdef class Primordial:
+    cdef ClassEngine engine
+    cdef perturbs * pt
+    cdef primordial * pm
+    cdef background * ba
+
+    cdef int _pkprim_many(self, const double * k, Py_ssize_t kstride,
+                          const double * tk, Py_ssize_t tstride, Py_ssize_t size,
+                          double * out, Py_ssize_t ostride) nogil
+
+cdef class PowerSpectrumInterpolator:
+    cdef readonly np.ndarray ln_k
+    cdef readonly np.ndarray ln_1pz
+    cdef readonly np.ndarray ln_pk
+    cdef readonly int linear
+    cdef public int nthreads
+
+    cdef np.ndarray d2k
+    cdef np.ndarray d2z
+    cdef np.ndarray d2kz
+    cdef Py_ssize_t nk, nz
+    cdef const double * _ln_k
+    cdef const double * _ln_1pz
+    cdef const double * _ln_pk
+    cdef const double * _d2k
+    cdef const double * _d2z
+    cdef const double * _d2kz
+
+    cdef _setup(self, ln_k, ln_1pz, ln_pk)
+    cdef _set_tables(self, np.ndarray ln_k, np.ndarray ln_1pz, np.ndarray ln_pk,
+                     np.ndarray d2k, np.ndarray d2z, np.ndarray d2kz)
+    cdef double evaluate(self, double k, double z) nogil
+    cdef Py_ssize_t evaluate_many(self, const double * k, const double * z, Py_ssize_t size,
+                                  double * out, int nthreads) nogil
+    cdef Py_ssize_t _evaluate_many(self, const double * k, Py_ssize_t kstride,
+                                   const double * z, Py_ssize_t zstride, Py_ssize_t size,
+                                   double * out, Py_ssize_t ostride, int nthreads) nogil
+
+cdef class Spectra:
+    cdef ClassEngine engine
+    cdef spectra * sp
+    cdef background * ba
+    cdef perturbs * pt
+    cdef primordial * pm
+    cdef nonlinear * nl
+    cdef readonly dict data
+    cdef dict _transfer_dtypes
+
+    cdef int pk_at_k_and_z(self, double k, double z, int linear, double * pk) nogil
+    cdef int pk(self, double k, double z, double * pk_ic, int lin, double * pk) except -1
+    cdef int _pk_many(self, const double * k, Py_ssize_t kstride,
+                      const double * z, Py_ssize_t zstride, Py_ssize_t size,
+                      int lin, double * out, Py_ssize_t ostride) nogil
+    cdef int _sigma8_many(self, const double * z, Py_ssize_t zstride, Py_ssize_t size,
+                          double * out, Py_ssize_t ostride, int nthreads) nogil
+    cdef Py_ssize_t _sigma_many(self, PowerSpectrumInterpolator pk,
+                                const double * k, Py_ssize_t nk,
+                                const double * W2, const double * dW2, Py_ssize_t nR,
+                                const double * z, Py_ssize_t nz,
+                                double * s2, double * ds2, int nthreads) nogil
+    cdef np.dtype _transfer_dtype(self, file_format outf)
+    cdef int _transfer_many(self, file_format outf, const double * z, Py_ssize_t size,
+                            int ntitles, double * data, Py_ssize_t stride, int nthreads) nogil
+    cdef np.ndarray _radial_table(self, double kf, Py_ssize_t size, double z, kind, int nthreads)
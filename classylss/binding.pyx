@@ -1,9 +1,17 @@
 #cython: embedsignature=True
 cimport cython
+from cython.parallel cimport prange, parallel, threadid
 import numpy as np
+import threading
+import time
+from concurrent.futures import Future, CancelledError
 cimport numpy as np
-from libc.stdlib cimport malloc, free
-from libc.string cimport memset, strncpy, strdup
+np.import_array()
+from libc.stdlib cimport malloc, calloc, free
+from libc.string cimport memset, memcpy, strncpy, strdup
+from libc.stdio cimport snprintf
+from libc.math cimport log, log1p, exp, expm1, sqrt, sin, cos, NAN, M_PI
+from cpython.ref cimport PyObject, Py_INCREF
 
 from classylss import get_data_files
 
@@ -11,6 +19,23 @@ _DATA_FILES = get_data_files()
 
 from classylss.cclassy cimport *
 
+# the OpenMP runtime, if the extension is built with it (see
+# CLASSYLSS_OPENMP in setup.py)
+cdef extern from *:
+    """
+    #ifdef _OPENMP
+    #include <omp.h>
+    #define CLASSYLSS_HAS_OPENMP 1
+    #else
+    #define CLASSYLSS_HAS_OPENMP 0
+    static int omp_get_max_threads(void) { return 1; }
+    static void omp_set_num_threads(int n) { (void) n; }
+    #endif
+    """
+    int CLASSYLSS_HAS_OPENMP
+    int omp_get_max_threads() nogil
+    void omp_set_num_threads(int nthreads) nogil
+
 DEF _Mpc_over_m_ = 3.085677581282e22  #/**< conversion factor from meters to megaparsecs */
                           #/* remark: CAMB uses 3.085678e22: good to know if you want to compare  with high accuracy */
 DEF _Gyr_over_Mpc_ = 3.06601394e2 #/**< conversion factor from megaparsecs to gigayears
@@ -25,6 +50,92 @@ DEF _h_P_ = 6.62606896e-34
 
 DEF _MAXTITLESTRINGLENGTH_ = 8000
 
+# tolerance on the range checks of the spline tables, in units of the spacing
+DEF _SPLINE_RANGE_TOL_ = 1e-6
+
+# columns of the FastBackground tables
+DEF _FB_DISTANCE_ = 0
+DEF _FB_HUBBLE_ = 1
+DEF _FB_GROWTH_FACTOR_ = 2
+DEF _FB_GROWTH_RATE_ = 3
+DEF _FB_TIME_ = 4
+DEF _FB_SIZE_ = 5
+DEF _FB_INVERSE_ = -1
+
+# the number of values converted at once by the chunked iteration of the
+# vectorized accessors
+DEF _CHUNK_SIZE_ = 65536
+
+# number of OpenMP threads used by the vectorized accessors
+cdef int _num_threads = 1
+
+def set_num_threads(int nthreads):
+    r"""
+    Set the default number of threads used by the vectorized accessors,
+    e.g., :func:`Background.compute_for_z`.
+
+    Parameters
+    ----------
+    nthreads : int
+      the number of OpenMP threads; must be at least 1
+    """
+    global _num_threads
+    if nthreads < 1:
+        raise ValueError("number of threads must be at least 1")
+    _num_threads = nthreads
+
+def get_num_threads():
+    r"""
+    Return the default number of threads used by the vectorized accessors.
+    """
+    return _num_threads
+
+cdef int _thread_count(nthreads) except -1:
+    r"""
+    The number of threads of an accessor, ``nthreads`` or the value set by
+    :func:`set_num_threads` if None.
+    """
+    if nthreads is None:
+        return _num_threads
+    if nthreads < 1:
+        raise ValueError("number of threads must be at least 1")
+    return nthreads
+
+# whether float32 inputs give float32 results; see set_float32_results
+cdef bint _float32_results = False
+
+def set_float32_results(bint enabled):
+    r"""
+    Enable or disable the float32 results of the vectorized accessors.
+
+    When enabled, the accessors, e.g. :func:`Background.comoving_distance`
+    or :func:`Spectra.get_pk`, return float32 arrays if all their array
+    arguments are of single or half precision, as a numpy ufunc would. The
+    values are still computed in double precision, and float32 inputs are
+    converted chunk by chunk, so large catalogs are never upcast as a
+    whole. When disabled, the default, the results are float64.
+
+    Parameters
+    ----------
+    enabled : bool
+      whether float32 inputs give float32 results
+    """
+    global _float32_results
+    _float32_results = enabled
+
+def get_float32_results():
+    r"""
+    Return whether float32 inputs give float32 results; see
+    :func:`set_float32_results`.
+    """
+    return bool(_float32_results)
+
+openmp = bool(CLASSYLSS_HAS_OPENMP)
+"""
+Whether classylss and CLASS are built with OpenMP; if not, all the
+thread counts are ignored.
+"""
+
 class ClassRuntimeError(RuntimeError):
     def __init__(self, message=""):
         self.message = message
@@ -108,7 +219,428 @@ cdef np.dtype _titles_to_dtype(char * titles, int remove_units=False):
         dtype = np.dtype([(str(name), 'f8') for name in names])
     return dtype
 
+cdef class _TableOwner:
+    r"""
+    The base of the views of :func:`_table_view`, which keeps the engine
+    alive and counts the live views of each module, so that the engine
+    does not free the tables under them; see :func:`ClassEngine._check_views`.
+    """
+    cdef ClassEngine engine
+    cdef object module
+
+    def __cinit__(self, ClassEngine engine, module):
+        self.engine = engine
+        self.module = module
+        engine._views[module] = engine._views.get(module, 0) + 1
+
+    def __dealloc__(self):
+        if self.engine is not None:
+            self.engine._views[self.module] -= 1
+
+cdef np.ndarray _table_view(double * data, shape, ClassEngine engine, module):
+    r"""
+    Return a read-only array of the given shape viewing the CLASS table
+    ``data`` of ``module``, without copying. While the array is alive,
+    the engine refuses to free the module.
+    """
+    cdef np.npy_intp dims[3]
+    cdef int i
+    cdef int nd = len(shape)
+    cdef np.ndarray arr
+
+    if data == NULL:
+        raise ClassRuntimeError("the table has not been computed")
+
+    for i in range(nd):
+        dims[i] = shape[i]
+
+    arr = np.PyArray_SimpleNewFromData(nd, dims, np.NPY_DOUBLE, data)
+    np.set_array_base(arr, _TableOwner(engine, module))
+    arr.flags.writeable = False
+    return arr
+
+def _result_dtype(inputs):
+    r"""
+    The dtype of the results for ``inputs``: with
+    :func:`set_float32_results`, float32 if all the array inputs are of
+    single or half precision, float64 otherwise. Python scalars do not
+    count, so ``get_pk(k.astype('f4'), 0.5)`` gives single precision, as
+    a numpy ufunc would.
+    """
+    if not _float32_results:
+        return np.dtype('f8')
+    single = None
+    for x in inputs:
+        if isinstance(x, (int, float)):
+            continue
+        dtype = np.asarray(x).dtype
+        single = (single is not False) and dtype in (np.float16, np.float32)
+    return np.dtype('f4') if single else np.dtype('f8')
+
+def _chunks(operands, int nout=1):
+    r"""
+    Return an iterator over the broadcast ``operands`` in one-dimensional
+    chunks of float64 values; the last ``nout`` operands are outputs, and
+    are allocated if None, of the dtype given by :func:`_result_dtype`.
+
+    Inputs of another type are converted chunk by chunk, and strided
+    inputs are not copied, so the kernels take strides; see
+    :func:`_chunk_stride`. The computation is always done in double
+    precision, and only the chunks are converted, so float32 arrays are
+    read and written without full size temporaries.
+    """
+    nin = len(operands) - nout
+    operands = list(operands)
+    if nout > 0 and _result_dtype(operands[:nin]) == np.float32:
+        shape = np.broadcast(*operands[:nin]).shape
+        for i in range(nin, len(operands)):
+            if operands[i] is None:
+                operands[i] = np.empty(shape, dtype='f4')
+    op_flags = [['readonly', 'aligned']] * nin + [['writeonly', 'allocate', 'aligned', 'no_broadcast']] * nout
+    return np.nditer(operands,
+                     flags=['external_loop', 'buffered', 'grow_inner', 'zerosize_ok'],
+                     op_flags=op_flags, op_dtypes=['f8'] * len(operands),
+                     casting='same_kind', order='C', buffersize=_CHUNK_SIZE_)
+
+def _one_plus_z(z, out):
+    r"""
+    Return :math:`1 + z`, in ``out`` if given, else in a new array of the
+    dtype given by :func:`_result_dtype`.
+    """
+    if out is None:
+        out = np.empty(np.shape(z), _result_dtype([z]))
+    return np.add(z, 1., out=out)
+
+def _unaliased(z, out):
+    r"""
+    Return ``z``, or a copy of it if it may share memory with ``out``, for
+    the accessors that read ``z`` again after writing ``out``, e.g. with
+    ``out=z``.
+    """
+    if out is not None and np.may_share_memory(z, out):
+        return np.array(z, copy=True)
+    return z
+
+def _columns_out(z, Py_ssize_t ncol, out):
+    r"""
+    Return the output of ``ncol`` columns of a vector at redshifts ``z``,
+    of shape ``z.shape + (ncol,)``, allocating it if ``out`` is None.
+    """
+    shape = np.shape(z) + (ncol,)
+    if out is None:
+        return np.empty(shape, _result_dtype([z]))
+    if out.shape != shape or out.dtype not in (np.float32, np.float64) or not out.flags.c_contiguous:
+        raise ValueError("out must be a C-contiguous float32 or float64 array of shape %s" % str(shape))
+    return out
 
+cdef inline double * _chunk_data(np.ndarray chunk):
+    return <double*> np.PyArray_DATA(chunk)
+
+cdef inline Py_ssize_t _chunk_stride(np.ndarray chunk):
+    r"""
+    The stride of a chunk of :func:`_chunks`, in number of values.
+    """
+    return chunk.strides[0] // <Py_ssize_t> sizeof(double)
+
+cdef int _is_monotonic(const double * x, Py_ssize_t stride, Py_ssize_t size) nogil:
+    r"""
+    Return 1 if ``x``, stored every ``stride`` values, is sorted, in
+    increasing or decreasing order.
+    """
+    cdef Py_ssize_t i
+    cdef int increasing = 1
+    cdef int decreasing = 1
+
+    for i in range(1, size):
+        if x[i*stride] < x[(i-1)*stride]: increasing = 0
+        if x[i*stride] > x[(i-1)*stride]: decreasing = 0
+        if not (increasing or decreasing):
+            return 0
+    return 1
+
+cdef void _record_failure(char * slot, const char * message) nogil:
+    r"""
+    Keep ``message`` in the ``slot`` of the calling thread, of
+    ``sizeof(ErrorMsg)`` bytes, if it holds no earlier failure.
+    """
+    if slot != NULL and slot[0] == 0:
+        strncpy(slot, message, sizeof(ErrorMsg) - 1)
+
+cdef void _first_failure(const char * slots, int nslots, char * error_message) nogil:
+    r"""
+    Copy the first failure recorded in ``slots`` by :func:`_record_failure`
+    to ``error_message``, once the threads are done.
+    """
+    cdef int i
+    if slots != NULL:
+        for i in range(nslots):
+            if slots[i * sizeof(ErrorMsg)] != 0:
+                strncpy(error_message, &slots[i * sizeof(ErrorMsg)], sizeof(ErrorMsg) - 1)
+                error_message[sizeof(ErrorMsg) - 1] = 0
+                return
+    strncpy(error_message, "could not allocate the workspace of the threads", sizeof(ErrorMsg) - 1)
+
+cdef int _spectra_pk_many(background * pba, primordial * ppm, spectra * psp, int nonlinear,
+                          const double * k, Py_ssize_t kstride,
+                          const double * z, Py_ssize_t zstride, Py_ssize_t size,
+                          double * out, Py_ssize_t ostride) nogil:
+    r"""
+    The loop of :func:`Spectra._pk_many` on the structures ``pba``, ``ppm``
+    and ``psp``, so that threads can pass their own copy of ``psp``, where
+    CLASS writes its errors.
+    """
+    cdef Py_ssize_t i
+    cdef int status = _SUCCESS_
+    cdef double h = pba.h
+    cdef double h3 = h * h * h
+    cdef double * pk_ic
+
+    pk_ic = <double*> malloc(sizeof(double) * psp.ic_ic_size[psp.index_md_scalars])
+    if pk_ic == NULL:
+        strncpy(psp.error_message, "could not allocate isocurvature workspace", sizeof(ErrorMsg))
+        return _FAILURE_
+
+    for i in range(size):
+        if nonlinear:
+            status = spectra_pk_nl_at_k_and_z(pba, ppm, psp, k[i*kstride] * h,
+                                              z[i*zstride], &out[i*ostride])
+        else:
+            status = spectra_pk_at_k_and_z(pba, ppm, psp, k[i*kstride] * h,
+                                           z[i*zstride], &out[i*ostride], pk_ic)
+        if status == _FAILURE_:
+            break
+
+        # internally class uses Mpc ** 3
+        out[i*ostride] *= h3
+
+    free(pk_ic)
+    return status
+
+cdef int _tau_of_z_closeby(background * pba, double z, int * last_index, double * tau) nogil:
+    r"""
+    Same as ``background_tau_of_z``, but starts the search of the
+    interval from ``last_index`` and walks from there, which is amortized
+    O(1) for sorted inputs. ``last_index`` is updated on return.
+
+    The spline is the one used by ``background_tau_of_z``; note the
+    ``z_table`` of CLASS is in decreasing order.
+    """
+    cdef int n = pba.bt_size
+    cdef int inf = last_index[0]
+    cdef double * x = pba.z_table
+    cdef double h, a, b
+
+    if z > x[0] or z < x[n-1]:
+        snprintf(pba.error_message, sizeof(ErrorMsg),
+                 "out of range: z=%e < z_min=%e or z > z_max=%e", z, x[n-1], x[0])
+        return _FAILURE_
+
+    if inf < 0 or inf > n - 2:
+        inf = 0
+
+    # find inf such that x[inf] >= z >= x[inf+1]
+    while inf > 0 and z > x[inf]:
+        inf -= 1
+    while inf < n - 2 and z < x[inf+1]:
+        inf += 1
+    last_index[0] = inf
+
+    h = x[inf+1] - x[inf]
+    b = (z - x[inf]) / h
+    a = 1. - b
+    tau[0] = (a * pba.tau_table[inf] + b * pba.tau_table[inf+1]
+              + ((a*a*a - a) * pba.d2tau_dz2_table[inf]
+                 + (b*b*b - b) * pba.d2tau_dz2_table[inf+1]) * h * h / 6.)
+    return _SUCCESS_
+
+cdef int _spline_coefficients(const double * x, const double * y, Py_ssize_t size,
+                              Py_ssize_t stride, double * y2, double * work) nogil:
+    r"""
+    Compute the second derivatives ``y2`` of the cubic spline through
+    ``(x, y)``, with ``x`` increasing. ``y`` and ``y2`` are read and
+    written every ``stride`` values, and ``work`` holds ``size`` doubles.
+
+    The first derivatives at both ends are estimated from the three
+    closest points, as done by CLASS with ``_SPLINE_EST_DERIV_``.
+    Requires ``size >= 3``.
+    """
+    cdef Py_ssize_t i
+    cdef double h1, h2, dy0, dyn, sig, p
+    cdef Py_ssize_t n = size
+
+    h1 = x[1] - x[0]
+    h2 = x[2] - x[1]
+    dy0 = (- (2 * h1 + h2) / (h1 * (h1 + h2)) * y[0]
+           + (h1 + h2) / (h1 * h2) * y[stride]
+           - h1 / (h2 * (h1 + h2)) * y[2*stride])
+
+    h1 = x[n-1] - x[n-2]
+    h2 = x[n-2] - x[n-3]
+    dyn = ((2 * h1 + h2) / (h1 * (h1 + h2)) * y[(n-1)*stride]
+           - (h1 + h2) / (h1 * h2) * y[(n-2)*stride]
+           + h1 / (h2 * (h1 + h2)) * y[(n-3)*stride])
+
+    y2[0] = -0.5
+    work[0] = (3. / (x[1] - x[0])) * ((y[stride] - y[0]) / (x[1] - x[0]) - dy0)
+
+    for i in range(1, n - 1):
+        sig = (x[i] - x[i-1]) / (x[i+1] - x[i-1])
+        p = sig * y2[(i-1)*stride] + 2.
+        y2[i*stride] = (sig - 1.) / p
+        work[i] = ((y[(i+1)*stride] - y[i*stride]) / (x[i+1] - x[i])
+                   - (y[i*stride] - y[(i-1)*stride]) / (x[i] - x[i-1]))
+        work[i] = (6. * work[i] / (x[i+1] - x[i-1]) - sig * work[i-1]) / p
+
+    h1 = x[n-1] - x[n-2]
+    p = (3. / h1) * (dyn - (y[(n-1)*stride] - y[(n-2)*stride]) / h1)
+    y2[(n-1)*stride] = (p - 0.5 * work[n-2]) / (0.5 * y2[(n-2)*stride] + 1.)
+
+    for i in range(n - 2, -1, -1):
+        y2[i*stride] = y2[i*stride] * y2[(i+1)*stride] + work[i]
+
+    return _SUCCESS_
+
+cdef inline double _splint_uniform(const double * y, const double * y2, Py_ssize_t size,
+                                   double u, double h2_6) nogil:
+    r"""
+    Evaluate a cubic spline tabulated on a uniform grid at ``u``, the
+    position in units of the grid spacing from the first node. ``h2_6``
+    is the spacing squared over 6.
+
+    There is no branch: ``u`` is clamped to the grid, so callers check the
+    range separately.
+    """
+    cdef Py_ssize_t i
+    cdef double a, b
+
+    u = min(max(u, 0.), size - 1.)
+    i = min(<Py_ssize_t> u, size - 2)
+    b = u - i
+    a = 1. - b
+    return a * y[i] + b * y[i+1] + ((a*a*a - a) * y2[i] + (b*b*b - b) * y2[i+1]) * h2_6
+
+cdef inline double _splint_uniform_deriv(const double * y, const double * y2, Py_ssize_t size,
+                                         double u, double h) nogil:
+    r"""
+    Derivative of the uniform cubic spline evaluated by
+    :func:`_splint_uniform`, with ``h`` the grid spacing.
+    """
+    cdef Py_ssize_t i
+    cdef double a, b
+
+    u = min(max(u, 0.), size - 1.)
+    i = min(<Py_ssize_t> u, size - 2)
+    b = u - i
+    a = 1. - b
+    return (y[i+1] - y[i]) / h + ((3 * b * b - 1.) * y2[i+1] - (3 * a * a - 1.) * y2[i]) * h / 6.
+
+cdef inline Py_ssize_t _bisect(const double * x, Py_ssize_t size, double v) nogil:
+    r"""
+    Return the index ``i`` in ``[0, size-2]`` such that
+    ``x[i] <= v <= x[i+1]``, with ``x`` increasing; ``v`` outside of the
+    table gives the first or last interval.
+    """
+    cdef Py_ssize_t lo = 0
+    cdef Py_ssize_t hi = size - 1
+    cdef Py_ssize_t mid
+
+    while hi - lo > 1:
+        mid = (lo + hi) >> 1
+        if x[mid] > v:
+            hi = mid
+        else:
+            lo = mid
+    return lo
+
+
+cdef int _primordial_at_k(primordial * ppm, double k, double * pk, double * work) nogil:
+    r"""
+    The primordial power spectrum of the scalar adiabatic mode at ``k`` in
+    :math:`\mathrm{Mpc}^{-1}`, without the GIL.
+
+    For the analytic spectrum without isocurvature modes, this is the
+    closed form :math:`A_s \exp[(n_s - 1) L + \alpha_s L^2 / 2 + \beta_s L^3 / 6]`,
+    with :math:`L = \ln(k / k_0)`, instead of the spline of the ``lnk``
+    table. ``work`` holds the ``ic_ic_size`` values of the spline
+    otherwise. The same range check as CLASS is applied in both cases.
+    """
+    cdef double lnk, L
+
+    if k == 0: # forcefully set k == 0 to zero.
+        pk[0] = 0.
+        return _SUCCESS_
+
+    if ppm.primordial_spec_type == analytic_Pk and ppm.ic_size[0] == 1:
+        lnk = log(k)
+        if lnk < ppm.lnk[0] or lnk > ppm.lnk[ppm.lnk_size-1]:
+            snprintf(ppm.error_message, sizeof(ErrorMsg),
+                     "k=%e out of range [%e : %e]", k, exp(ppm.lnk[0]), exp(ppm.lnk[ppm.lnk_size-1]))
+            return _FAILURE_
+        L = lnk - log(ppm.k_pivot)
+        pk[0] = ppm.A_s * exp(L * (ppm.n_s - 1. + L * (0.5 * ppm.alpha_s + L * ppm.beta_s / 6.)))
+        return _SUCCESS_
+
+    if primordial_spectrum_at_k(ppm, 0, linear, k, work) == _FAILURE_:
+        return _FAILURE_
+    pk[0] = work[0]
+    return _SUCCESS_
+
+cdef inline Py_ssize_t _fftfreq(Py_ssize_t i, Py_ssize_t n) nogil:
+    r"""
+    The integer frequency of index ``i`` of an FFT axis of size ``n``;
+    the Nyquist index is positive.
+    """
+    return i if i <= n // 2 else i - n
+
+cdef void _paint_radial(char * data, const Py_ssize_t * shape, const Py_ssize_t * strides,
+                        int dtype, const Py_ssize_t * nmesh, const Py_ssize_t * offset,
+                        const double * table, int multiply, int nthreads) nogil:
+    r"""
+    Assign or multiply the 3D grid at ``data``, of ``shape`` and byte
+    ``strides``, by ``table[n]``, with ``n`` the squared integer frequency
+    of each cell on a mesh of ``nmesh`` cells, of which the grid starts at
+    index ``offset``.
+
+    ``dtype`` is 0, 1, 2 or 3 for float32, float64, complex64 and
+    complex128. Assigning a complex grid sets the imaginary part to zero.
+    The planes of the first axis are painted in parallel.
+    """
+    cdef Py_ssize_t i, j, l, f0, f1, f2
+    cdef double v
+    cdef char * p
+
+    for i in prange(shape[0], schedule='static', num_threads=nthreads):
+        f0 = _fftfreq(i + offset[0], nmesh[0])
+        for j in range(shape[1]):
+            f1 = _fftfreq(j + offset[1], nmesh[1])
+            for l in range(shape[2]):
+                f2 = _fftfreq(l + offset[2], nmesh[2])
+                v = table[f0 * f0 + f1 * f1 + f2 * f2]
+                p = data + i * strides[0] + j * strides[1] + l * strides[2]
+                if dtype == 0:
+                    if multiply:
+                        (<float*> p)[0] = (<float*> p)[0] * v
+                    else:
+                        (<float*> p)[0] = v
+                elif dtype == 1:
+                    if multiply:
+                        (<double*> p)[0] = (<double*> p)[0] * v
+                    else:
+                        (<double*> p)[0] = v
+                elif dtype == 2:
+                    if multiply:
+                        (<float*> p)[0] = (<float*> p)[0] * v
+                        (<float*> p)[1] = (<float*> p)[1] * v
+                    else:
+                        (<float*> p)[0] = v
+                        (<float*> p)[1] = 0
+                else:
+                    if multiply:
+                        (<double*> p)[0] = (<double*> p)[0] * v
+                        (<double*> p)[1] = (<double*> p)[1] * v
+                    else:
+                        (<double*> p)[0] = v
+                        (<double*> p)[1] = 0
 
 def _build_task_dependency(tasks):
     r"""
@@ -149,43 +681,176 @@ def _build_task_dependency(tasks):
     return tasks
 
 
-ctypedef struct ready_flags:
-    int fc
-    int ba
-    int th
-    int pt
-    int pm
-    int nl
-    int tr
-    int sp
-    int op
-    int le
-    int input
+# the CLASS modules, in the order of their initialization
+_MODULES = ["input", "background", "thermodynamics", "perturb",
+            "primordial", "nonlinear", "transfer", "spectra", "lensing"]
+
+# the modules that can be freed by ClassEngine.release; the queries of the
+# wrappers read the background and primordial structures directly
+_RELEASABLE = ["thermodynamics", "perturb", "nonlinear", "transfer",
+               "spectra", "lensing"]
+
+# parameters that are only read by the primordial module; changing them
+# leaves the background, thermodynamics and perturbations untouched.
+_PRIMORDIAL_PARAMETERS = set([
+    "A_s", "ln10^{10}A_s", "n_s", "alpha_s", "beta_s", "k_pivot",
+    ])
+
+# precision parameters that are only used by the nonlinear module
+_NONLINEAR_PARAMETERS = set([
+    "halofit_dz", "halofit_min_k_nonlinear", "halofit_sigma_precision",
+    "halofit_min_k_max", "halofit_k_per_decade",
+    ])
+
+def _first_affected_module(keys):
+    r"""
+    Return the first module in :data:`_MODULES` that depends on any of
+    the parameter names in ``keys``.
+    """
+    first = len(_MODULES)
+    for key in keys:
+        if key in _NONLINEAR_PARAMETERS:
+            first = min(first, _MODULES.index("nonlinear"))
+        elif key in _PRIMORDIAL_PARAMETERS:
+            first = min(first, _MODULES.index("primordial"))
+        else:
+            return "input"
+    if first == len(_MODULES): return None
+    return _MODULES[first]
+
+class ComputeFuture(Future):
+    r"""
+    The future of :func:`ClassEngine.compute_async`, whose result is the
+    engine once the modules are computed.
+
+    It can be awaited with ``asyncio.wrap_future``. Unlike other futures, a
+    running computation can be cancelled: :func:`cancel` then stops it
+    before the next module, and the future raises
+    :class:`concurrent.futures.CancelledError`. The modules computed so far
+    are kept by the engine.
+
+    Attributes
+    ----------
+    engine : ClassEngine
+      the engine being computed
+    level : str
+      the requested module
+    modules : list of str
+      the modules that are computed, once the computation has started
+    completed : list of str
+      the modules computed so far
+    progress : callable
+      if set, called from the worker thread as
+      ``progress(module, len(completed), len(modules))`` after each module;
+      the module is ready, so the callback can query the engine
+    """
+    def __init__(self, engine, level, progress=None):
+        Future.__init__(self)
+        self.engine = engine
+        self.level = level
+        self.progress = progress
+        self.modules = []
+        self.completed = []
+        self._interrupt = threading.Event()
+        self._interrupted = False
+
+    def cancel(self):
+        r"""
+        Cancel the computation; return False if it has already finished.
+        A running computation stops before the next module, so the result
+        may still be set if the last module was already running.
+        """
+        if Future.cancel(self):
+            return True
+        if self.done():
+            return False
+        self._interrupt.set()
+        return True
+
+    def cancelled(self):
+        return Future.cancelled(self) or self._interrupted
+
+    def _check(self, module):
+        if self._interrupt.is_set():
+            raise CancelledError("the computation was cancelled before the %s module" % module)
+
+    def _report(self, module, int status):
+        # modules computed by the callbacks are not part of the request
+        if status == _SUCCESS_ and module in self.modules:
+            self.completed.append(module)
+            if self.progress is not None:
+                self.progress(module, len(self.completed), len(self.modules))
+
+    def _run(self):
+        if not self.set_running_or_notify_cancel():
+            return
+        try:
+            (<ClassEngine> self.engine)._locked_compute(self.level, self)
+        except CancelledError as e:
+            self._interrupted = True
+            self.set_exception(e)
+        except BaseException as e:
+            self.set_exception(e)
+        else:
+            self.set_result(self.engine)
 
+def _rebuild_engine(pars, level, nthreads=None):
+    r"""
+    Unpickle a :class:`ClassEngine`, recomputing its modules up to ``level``.
+    """
+    cdef ClassEngine engine = ClassEngine(pars, nthreads=nthreads or None)
+    if level is not None:
+        engine.compute(level)
+    return engine
+
+def _rebuild_from_state(cls, state, nthreads):
+    r"""
+    Unpickle an object built with ``from_state``.
+    """
+    return cls.from_state(state, nthreads=nthreads or None)
 
 cdef class ClassEngine:
     """
     The default CLASS engine class, which initializes CLASS from an input
     set of parameters.
 
+    Only the input parameters are parsed at construction; the CLASS modules
+    are computed when the wrappers first need them.
+
     Parameters
     ----------
     pars : dict, optional
       a dictionary of parameters to initialize CLASS with
+    outputs : list of str, optional
+      the CLASS outputs that will be used, e.g. ``['mPk', 'dTk']``; this
+      sets the 'output' parameter, so that CLASS does not compute any
+      other spectra.
+    nthreads : int, optional
+      the number of OpenMP threads of the CLASS modules, which loop over
+      the wavenumbers internally; by default the OpenMP default is used,
+      i.e. ``OMP_NUM_THREADS`` or the number of cores. Use 1 when many
+      engines are computed at once, e.g. with :func:`classylss.batch.run_many`.
+
+    Attributes
+    ----------
+    timings : dict
+      the ``'wall'`` and ``'cpu'`` time in seconds of the initialization of
+      each computed module. The CPU time is that of the whole process, so
+      it includes the OpenMP threads of CLASS, and the other threads of
+      Python if engines are computed concurrently.
+    memory : dict
+      the size in bytes of the main tables of each computed module, as a
+      dictionary for each module
+    trace : callable
+      if set, called as ``trace(module, event, info)`` before (``event`` is
+      ``'start'`` and ``info`` None) and after (``'end'``, with the entry
+      of :attr:`timings`) the initialization of each module. The module is
+      ready when ``'end'`` is reported, so the callback can query it; an
+      exception raised by the callback aborts the computation, leaving
+      the computed modules valid; if the module failed, its error is
+      raised instead. Updating or releasing the engine from
+      the callback is not allowed.
     """
-    cdef precision pr
-    cdef background ba
-    cdef thermo th
-    cdef perturbs pt
-    cdef primordial pm
-    cdef nonlinear nl
-    cdef transfers tr
-    cdef spectra sp
-    cdef output op
-    cdef lensing le
-    cdef ready_flags ready
-    cdef file_content fc
-
     property parameter_file:
         """
         A string holding the parameter names and values as loaded by CLASS.
@@ -199,8 +864,32 @@ cdef class ClassEngine:
 
     def __cinit__(self, *args, **kwargs):
         memset(&self.ready, 0, sizeof(self.ready))
-
-    def __init__(self, object pars={}):
+        # reentrant, so that the trace and progress callbacks can query the
+        # engine while it is computed
+        self._lock = threading.RLock()
+        self._computing = 0
+        self.timings = {}
+        self.memory = {}
+        self.trace = None
+        self._released = set()
+        self._request = None
+        self._views = {}
+        self._derived = {}
+
+    def __init__(self, object pars={}, outputs=None, nthreads=None):
+        pars = dict(pars)
+        if outputs is not None:
+            if 'output' in pars:
+                raise ValueError("specify either the 'output' parameter or outputs, not both")
+            if isinstance(outputs, str):
+                outputs = outputs.split()
+            pars['output'] = ' '.join(outputs)
+
+        if nthreads is not None and nthreads < 1:
+            raise ValueError("number of threads must be at least 1")
+        self.nthreads = 0 if nthreads is None else nthreads
+
+        self.pars = pars
         _build_file_content(pars, &self.fc)
         self.ready.fc = True
         self.compute('input')
@@ -216,21 +905,456 @@ cdef class ClassEngine:
         if self.ready.th: thermodynamics_free(&self.th)
         if self.ready.ba: background_free(&self.ba)
 
-    cdef compute(self, level):
+    def __reduce__(self):
+        # the CLASS structs cannot be shipped, so the modules are
+        # recomputed from the parameters when unpickled
+        return (_rebuild_engine, (self.pars, self.level, self.nthreads))
+
+    property level:
+        """
+        The last CLASS module that has been computed.
+        """
+        def __get__(self):
+            flags = [self.ready.input, self.ready.ba, self.ready.th,
+                     self.ready.pt, self.ready.pm, self.ready.nl,
+                     self.ready.tr, self.ready.sp, self.ready.le]
+            for module, flag in reversed(list(zip(_MODULES, flags))):
+                if flag: return module
+            return None
+
+    property released:
+        """
+        The modules freed by :func:`release`, in the order of
+        initialization.
+        """
+        def __get__(self):
+            return [module for module in _MODULES if module in self._released]
+
+    def release(self, modules=None, retain=None):
+        r"""
+        Free the tables of CLASS modules that are no longer needed, e.g. the
+        perturbations and transfer functions once the power spectrum is
+        computed.
+
+        The released modules are not recomputed: the queries that need
+        them, or a module depending on them, raise a
+        :class:`ClassRuntimeError`. :func:`update` clears this for the
+        modules it recomputes. A module is not released while views of its
+        tables are alive.
+
+        Parameters
+        ----------
+        modules : str or list of str, optional
+          the modules to release; one of ``'thermodynamics'``,
+          ``'perturb'``, ``'nonlinear'``, ``'transfer'``, ``'spectra'`` and
+          ``'lensing'``. The background and primordial modules are always
+          retained.
+        retain : list of str, optional
+          alternatively, the modules to keep; all the other computed
+          modules that can be released are
+
+        Returns
+        -------
+        list of str :
+          the modules that were freed
+        """
+        if (modules is None) == (retain is None):
+            raise ValueError("specify either modules or retain")
+
+        if retain is not None:
+            if isinstance(retain, str):
+                retain = [retain]
+            for module in retain:
+                if module not in _MODULES:
+                    raise ValueError("unknown module '%s'; valid names are %s" % (module, ', '.join(_MODULES)))
+            modules = [module for module in _RELEASABLE if module not in retain]
+        elif isinstance(modules, str):
+            modules = [modules]
+
+        for module in modules:
+            if module not in _MODULES:
+                raise ValueError("unknown module '%s'; valid names are %s" % (module, ', '.join(_MODULES)))
+            if module not in _RELEASABLE:
+                raise ValueError("the %s module cannot be released; valid names are %s"
+                                 % (module, ', '.join(_RELEASABLE)))
+
+        freed = []
+        with self._lock:
+            self._check_not_computing()
+            self._check_views([module for module in modules if self._is_ready(module)])
+            for module in modules:
+                if not self._is_ready(module):
+                    continue
+                if module == "lensing":
+                    lensing_free(&self.le)
+                    self.ready.le = False
+                elif module == "spectra":
+                    spectra_free(&self.sp)
+                    self.ready.sp = False
+                elif module == "transfer":
+                    transfer_free(&self.tr)
+                    self.ready.tr = False
+                elif module == "nonlinear":
+                    nonlinear_free(&self.nl)
+                    self.ready.nl = False
+                elif module == "perturb":
+                    perturb_free(&self.pt)
+                    self.ready.pt = False
+                elif module == "thermodynamics":
+                    thermodynamics_free(&self.th)
+                    self.ready.th = False
+                self.memory.pop(module, None)
+                self._drop_derived([module])
+                self._released.add(module)
+                freed.append(module)
+        return freed
+
+    def update(self, object pars):
+        r"""
+        Update some of the parameters, recomputing only the modules that
+        depend on them.
+
+        The modules are recomputed up to the last module computed before
+        the update. If only primordial or halofit precision parameters
+        change (e.g. ``A_s``, ``n_s``), the background, thermodynamics and
+        perturbations are kept, unless they were released; otherwise all
+        modules are recomputed.
+        The update is refused while views of the tables of a recomputed
+        module, e.g. :attr:`Spectra.ln_pk`, are alive.
+
+        Parameters
+        ----------
+        pars : dict
+          the parameters to change
+
+        Returns
+        -------
+        module : str
+          the first module that has been recomputed, or None if no
+          parameter changed.
+        """
+        new = dict(self.pars)
+        new.update(pars)
+
+        changed = [key for key in new
+                   if key not in self.pars
+                   or val2str(new[key]) != val2str(self.pars[key])]
+
+        start = _first_affected_module(changed)
+        if start is None: return None
+
+        with self._lock:
+            self._check_not_computing()
+            level = self.level
+            if level is None or _MODULES.index(level) < _MODULES.index(start):
+                # nothing computed depends on the changed parameters
+                start = "input"
+            elif start != "input":
+                # the kept modules cannot be reused if some of them needed
+                # to reach the level were released
+                tasks = _build_task_dependency([level])
+                kept = _MODULES[:_MODULES.index(start)]
+                if any(module in tasks and module in self._released for module in kept):
+                    start = "input"
+            self._check_views(_MODULES[_MODULES.index(start):])
+            self._update(new, start, level)
+        return start
+
+    cdef _check_views(self, modules):
+        r"""
+        Raise a :class:`ClassRuntimeError` if any of the table views of
+        ``modules`` (e.g. :attr:`Background.background_table`) is alive,
+        since freeing the modules would leave them reading freed memory.
+        """
+        for module in modules:
+            if self._views.get(module, 0) > 0:
+                raise ClassRuntimeError(
+                    "%d view(s) of the tables of the %s module are alive; delete them or "
+                    "copy them with numpy.array before freeing the module"
+                    % (self._views[module], module))
+
+    cdef _update(self, dict pars, start, level):
+        cdef file_content fc
+        cdef precision pr
+        cdef background ba
+        cdef thermo th
+        cdef perturbs pt
+        cdef primordial pm
+        cdef nonlinear nl
+        cdef transfers tr
+        cdef spectra sp
+        cdef output op
+        cdef lensing le
+        cdef ErrorMsg errmsg
+        cdef int status
+
+        if start == "input":
+            self._free_modules("input")
+            if self.ready.fc:
+                parser_free(&self.fc)
+                self.ready.fc = False
+            _build_file_content(pars, &self.fc)
+            self.ready.fc = True
+            self.pars = pars
+            if level is not None:
+                self._compute(level)
+            return
+
+        # parse the new parameters on the side, so a failure leaves the
+        # engine untouched
+        memset(&pr, 0, sizeof(pr))
+        memset(&ba, 0, sizeof(ba))
+        memset(&th, 0, sizeof(th))
+        memset(&pt, 0, sizeof(pt))
+        memset(&pm, 0, sizeof(pm))
+        memset(&nl, 0, sizeof(nl))
+        memset(&tr, 0, sizeof(tr))
+        memset(&sp, 0, sizeof(sp))
+        memset(&op, 0, sizeof(op))
+        memset(&le, 0, sizeof(le))
+        _build_file_content(pars, &fc)
+
+        with nogil:
+            status = input_init(&fc, &pr, &ba, &th, &pt, &tr, &pm, &sp,
+                                &nl, &le, &op, errmsg)
+            # the unchanged modules keep their own copy of the input
+            background_free(&ba)
+            thermodynamics_free(&th)
+            perturb_free(&pt)
+
+        if status == _FAILURE_:
+            # none of the structs is swapped in; pr holds no allocation
+            primordial_free(&pm)
+            nonlinear_free(&nl)
+            transfer_free(&tr)
+            spectra_free(&sp)
+            lensing_free(&le)
+            parser_free(&fc)
+            raise ClassParserError(errmsg.decode(), self.parameter_file)
+
+        # replace the parameters of the recomputed modules; pr only differs
+        # by the nonlinear precision parameters.
+        self._free_modules(start)
+        self.pr = pr
+        if start == "primordial":
+            self.pm = pm
+        else:
+            primordial_free(&pm)
+        self.nl = nl
+        self.tr = tr
+        self.sp = sp
+        self.le = le
+        self.op = op
+
+        parser_free(&self.fc)
+        self.fc = fc
+        self.pars = pars
+        self._compute(level)
+
+    cdef _drop_derived(self, modules):
+        r"""
+        Forget the objects built from the tables of ``modules``.
+        """
+        for key in list(self._derived):
+            if key[0] in modules:
+                del self._derived[key]
+
+    cdef _free_modules(self, start):
+        r"""
+        Free the module ``start`` and all the modules depending on it, in
+        the reverse order of initialization.
+        """
+        modules = _MODULES[_MODULES.index(start):]
+
+        for module in modules:
+            self.timings.pop(module, None)
+            self.memory.pop(module, None)
+            self._released.discard(module)
+        self._drop_derived(modules)
+
+        if "lensing" in modules and self.ready.le:
+            lensing_free(&self.le)
+            self.ready.le = False
+        if "spectra" in modules and self.ready.sp:
+            spectra_free(&self.sp)
+            self.ready.sp = False
+        if "transfer" in modules and self.ready.tr:
+            transfer_free(&self.tr)
+            self.ready.tr = False
+        if "nonlinear" in modules and self.ready.nl:
+            nonlinear_free(&self.nl)
+            self.ready.nl = False
+        if "primordial" in modules and self.ready.pm:
+            primordial_free(&self.pm)
+            self.ready.pm = False
+        if "perturb" in modules and self.ready.pt:
+            perturb_free(&self.pt)
+            self.ready.pt = False
+        if "thermodynamics" in modules and self.ready.th:
+            thermodynamics_free(&self.th)
+            self.ready.th = False
+        if "background" in modules and self.ready.ba:
+            background_free(&self.ba)
+            self.ready.ba = False
+        if "input" in modules:
+            # input_init expects zero-initialized structs, as in a new engine
+            memset(&self.pr, 0, sizeof(self.pr))
+            memset(&self.ba, 0, sizeof(self.ba))
+            memset(&self.th, 0, sizeof(self.th))
+            memset(&self.pt, 0, sizeof(self.pt))
+            memset(&self.pm, 0, sizeof(self.pm))
+            memset(&self.nl, 0, sizeof(self.nl))
+            memset(&self.tr, 0, sizeof(self.tr))
+            memset(&self.sp, 0, sizeof(self.sp))
+            memset(&self.op, 0, sizeof(self.op))
+            memset(&self.le, 0, sizeof(self.le))
+            self.ready.input = False
+
+    cpdef compute(self, level):
         r"""
         The main function, which executes all the 'init' methods for all
         the desired modules.
 
+        The GIL is released while CLASS runs, so engines can be computed
+        concurrently from several threads; calls on the same engine are
+        serialized by a lock.
+
         Parameters
         ----------
         level : str
           level of modules to arrive.
         """
+        # fast path for the accessors of the wrappers
+        if self._is_ready(level): return
+        self._locked_compute(level, None)
+
+    def compute_async(self, level, executor=None, progress=None):
+        r"""
+        Compute the modules up to ``level`` on a worker thread, without
+        blocking the caller.
+
+        Since the GIL is released while CLASS runs, the caller, e.g. an
+        event loop, stays responsive, and many engines can be computed
+        concurrently. The calls on the same engine are serialized, as with
+        :func:`compute`.
+
+        Parameters
+        ----------
+        level : str
+          level of modules to arrive.
+        executor : concurrent.futures.Executor, optional
+          the executor running the computation, e.g. to bound the number
+          of concurrent computations; by default, a new thread is started
+        progress : callable, optional
+          called from the worker thread as ``progress(module, ncompleted,
+          nmodules)`` after each module; the callback can query the
+          engine, but not update or release it
+
+        Returns
+        -------
+        ComputeFuture :
+          a future whose result is the engine; it can be cancelled while
+          running, which stops the computation before the next module
+
+        Examples
+        --------
+        >>> engine = ClassEngine({'output': 'mPk'})
+        >>> engine = await asyncio.wrap_future(engine.compute_async('spectra'))
+        """
+        self._is_ready(level)  # validates the name in the caller
+        future = ComputeFuture(self, level, progress)
+        if executor is not None:
+            executor.submit(future._run)
+        else:
+            t = threading.Thread(target=future._run)
+            t.daemon = True
+            t.start()
+        return future
+
+    cdef _locked_compute(self, level, request):
+        r"""
+        Compute the modules up to ``level`` under the lock of the engine,
+        reporting to ``request``, a :class:`ComputeFuture`, if not None.
+        """
+        # the number of threads is a per-thread setting of OpenMP, so this
+        # does not affect the other threads computing engines
+        cdef int saved = omp_get_max_threads()
+
+        with self._lock:
+            # a compute from a callback of an outer compute of this thread
+            # reports to the outer request
+            outer = self._request
+            if request is not None:
+                tasks = _build_task_dependency([level])
+                request.modules = [module for module in _MODULES
+                                   if module in tasks and not self._is_ready(module)]
+                self._request = request
+            if self.nthreads > 0:
+                omp_set_num_threads(self.nthreads)
+            self._computing += 1
+            try:
+                self._compute(level)
+            finally:
+                self._computing -= 1
+                self._request = outer
+                omp_set_num_threads(saved)
+
+    cdef _check_not_computing(self):
+        r"""
+        Raise a :class:`ClassRuntimeError` if called from a trace or
+        progress callback, where freeing modules would pull the tables
+        from under the running computation.
+        """
+        if self._computing > 0:
+            raise ClassRuntimeError("the engine cannot be updated or released "
+                                    "from a callback of its computation")
+
+    cdef int require(self, const char * level, char * error_message) nogil:
+        r"""
+        Compute the modules up to ``level`` if they are not yet, from code
+        running without the GIL, e.g., after :func:`update`.
+
+        Returns ``_FAILURE_`` if the computation failed, with the reason
+        copied to ``error_message``. The GIL is taken for the check, so
+        callers test the ready flag of the module first.
+        """
+        with gil:
+            try:
+                self.compute(level.decode('ascii'))
+            except Exception as e:
+                msg = str(e).encode()
+                strncpy(error_message, msg, sizeof(ErrorMsg) - 1)
+                return _FAILURE_
+        return _SUCCESS_
+
+    cdef int _is_ready(self, level) except -1:
+        r"""
+        Return 1 if the module ``level`` has been computed.
+        """
+        if level == "input": return self.ready.input
+        if level == "background": return self.ready.ba
+        if level == "thermodynamics": return self.ready.th
+        if level == "perturb": return self.ready.pt
+        if level == "primordial": return self.ready.pm
+        if level == "nonlinear": return self.ready.nl
+        if level == "transfer": return self.ready.tr
+        if level == "spectra": return self.ready.sp
+        if level == "lensing": return self.ready.le
+        raise ValueError("unknown CLASS module '%s'" % level)
+
+    cdef _compute(self, level):
         cdef file_content * fc = &self.fc
         cdef ErrorMsg errmsg
+        cdef int status
 
         tasks = _build_task_dependency([level])
 
+        for module in _MODULES:
+            if module in tasks and module in self._released:
+                raise ClassRuntimeError("the %s module was released, and is needed to compute "
+                                        "the %s module; use a new engine or update the parameters"
+                                        % (module, level))
+
         # --------------------------------------------------------------------
         # Check the presence for all CLASS modules in the list 'tasks'. If a
         # module is found in tasks, executure its "_init" method.
@@ -239,9 +1363,15 @@ cdef class ClassEngine:
         # non-understood parameters asked to the wrapper is a problematic
         # situation.
         if "input" in tasks and not self.ready.input:
-            if input_init(fc, &self.pr, &self.ba, &self.th,
-                          &self.pt, &self.tr, &self.pm, &self.sp,
-                          &self.nl, &self.le, &self.op, errmsg) == _FAILURE_:
+            self._begin("input")
+            with nogil:
+                status = input_init(fc, &self.pr, &self.ba, &self.th,
+                                    &self.pt, &self.tr, &self.pm, &self.sp,
+                                    &self.nl, &self.le, &self.op, errmsg)
+            if status == _SUCCESS_:
+                self.ready.input = True
+            self._end("input", status)
+            if status == _FAILURE_:
                 raise ClassParserError(errmsg.decode(), self.parameter_file)
 
             # This part is done to list all the unread parameters, for debugging
@@ -256,114 +1386,379 @@ cdef class ClassEngine:
                 import warnings
                 warnings.warn("Class did not read input parameter(s): %s" % ', '.join(
                               problematic_parameters))
-            self.ready.input = True
 
         # The following list of computation is straightforward. If the "_init"
         # methods fail, call `struct_cleanup` and raise a ClassBadValueError
         # with the error message from the faulty module of CLASS.
         if "background" in tasks and not self.ready.ba:
-            if background_init(&(self.pr), &(self.ba)) == _FAILURE_:
+            self._begin("background")
+            with nogil:
+                status = background_init(&(self.pr), &(self.ba))
+            if status == _SUCCESS_:
+                self.ready.ba = True
+            self._end("background", status)
+            if status == _FAILURE_:
                 raise ClassBadValueError(self.ba.error_message.decode())
-            self.ready.ba = True
 
         if "thermodynamics" in tasks and not self.ready.th:
-            if thermodynamics_init(&(self.pr), &(self.ba),
-                                   &(self.th)) == _FAILURE_:
+            self._begin("thermodynamics")
+            with nogil:
+                status = thermodynamics_init(&(self.pr), &(self.ba), &(self.th))
+            if status == _SUCCESS_:
+                self.ready.th = True
+            self._end("thermodynamics", status)
+            if status == _FAILURE_:
                 raise ClassBadValueError(self.th.error_message.decode())
-            self.ready.th = True
 
         if "perturb" in tasks and not self.ready.pt:
-            if perturb_init(&(self.pr), &(self.ba),
-                            &(self.th), &(self.pt)) == _FAILURE_:
+            self._begin("perturb")
+            with nogil:
+                status = perturb_init(&(self.pr), &(self.ba), &(self.th), &(self.pt))
+            if status == _SUCCESS_:
+                self.ready.pt = True
+            self._end("perturb", status)
+            if status == _FAILURE_:
                 raise ClassBadValueError(self.pt.error_message.decode())
-            self.ready.pt = True
 
         if "primordial" in tasks and not self.ready.pm:
-            if primordial_init(&(self.pr), &(self.pt),
-                               &(self.pm)) == _FAILURE_:
+            self._begin("primordial")
+            with nogil:
+                status = primordial_init(&(self.pr), &(self.pt), &(self.pm))
+            if status == _SUCCESS_:
+                self.ready.pm = True
+            self._end("primordial", status)
+            if status == _FAILURE_:
                 raise ClassBadValueError(self.pm.error_message.decode())
-            self.ready.pm = True
 
         if "nonlinear" in tasks and not self.ready.nl:
-            if nonlinear_init(&self.pr, &self.ba, &self.th,
-                              &self.pt, &self.pm, &self.nl) == _FAILURE_:
+            self._begin("nonlinear")
+            with nogil:
+                status = nonlinear_init(&self.pr, &self.ba, &self.th,
+                                        &self.pt, &self.pm, &self.nl)
+            if status == _SUCCESS_:
+                self.ready.nl = True
+            self._end("nonlinear", status)
+            if status == _FAILURE_:
                 raise ClassBadValueError(self.nl.error_message.decode())
-            self.ready.nl = True
 
         if "transfer" in tasks and not self.ready.tr:
-            if transfer_init(&(self.pr), &(self.ba), &(self.th),
-                             &(self.pt), &(self.nl), &(self.tr)) == _FAILURE_:
+            self._begin("transfer")
+            with nogil:
+                status = transfer_init(&(self.pr), &(self.ba), &(self.th),
+                                       &(self.pt), &(self.nl), &(self.tr))
+            if status == _SUCCESS_:
+                self.ready.tr = True
+            self._end("transfer", status)
+            if status == _FAILURE_:
                 raise ClassBadValueError(self.tr.error_message.decode())
-            self.ready.tr = True
 
         if "spectra" in tasks and not self.ready.sp:
-            if spectra_init(&(self.pr), &(self.ba), &(self.pt),
-                            &(self.pm), &(self.nl), &(self.tr),
-                            &(self.sp)) == _FAILURE_:
+            self._begin("spectra")
+            with nogil:
+                status = spectra_init(&(self.pr), &(self.ba), &(self.pt),
+                                      &(self.pm), &(self.nl), &(self.tr),
+                                      &(self.sp))
+            if status == _SUCCESS_:
+                self.ready.sp = True
+            self._end("spectra", status)
+            if status == _FAILURE_:
                 raise ClassBadValueError(self.sp.error_message.decode())
-            self.ready.sp = True
 
         if "lensing" in tasks and not self.ready.le:
-            if lensing_init(&(self.pr), &(self.pt), &(self.sp),
-                            &(self.nl), &(self.le)) == _FAILURE_:
+            self._begin("lensing")
+            with nogil:
+                status = lensing_init(&(self.pr), &(self.pt), &(self.sp),
+                                      &(self.nl), &(self.le))
+            if status == _SUCCESS_:
+                self.ready.le = True
+            self._end("lensing", status)
+            if status == _FAILURE_:
                 raise ClassBadValueError(self.le.error_message.decode())
-            self.ready.le = True
 
         # At this point, the cosmological instance contains everything needed. The
         # following functions are only to output the desired numbers
         return
 
+    cdef _begin(self, module):
+        r"""
+        Start the timers of ``module``; a cancelled :func:`compute_async`
+        stops here.
+        """
+        if self._request is not None:
+            self._request._check(module)
+        if self.trace is not None:
+            self.trace(module, 'start', None)
+        self.timings[module] = {'wall': time.perf_counter(), 'cpu': time.process_time()}
+
+    cdef _end(self, module, int status):
+        r"""
+        Stop the timers of ``module``, and record the size of its tables if
+        it was computed.
+        """
+        t = self.timings[module]
+        t['wall'] = time.perf_counter() - t['wall']
+        t['cpu'] = time.process_time() - t['cpu']
+        if status == _SUCCESS_:
+            self.memory[module] = self._module_memory(module)
+        else:
+            t['failed'] = True
+        if self._request is not None:
+            self._request._report(module, status)
+        if self.trace is not None:
+            if status == _SUCCESS_:
+                self.trace(module, 'end', t)
+            else:
+                # the error of CLASS is raised rather than that of the callback
+                try:
+                    self.trace(module, 'end', t)
+                except Exception:
+                    pass
+
+    cdef dict _module_memory(self, module):
+        r"""
+        The size in bytes of the main tables of ``module``, estimated from
+        the sizes in the CLASS structures.
+        """
+        cdef int md
+        cdef Py_ssize_t n
+        cdef Py_ssize_t d = sizeof(double)
+        r = {}
+
+        if module == "background":
+            # background_table and d2background_dtau2_table, and the tau/z tables
+            r['background_table'] = 2 * d * self.ba.bt_size * self.ba.bg_size
+            r['tau_z_tables'] = 4 * d * self.ba.bt_size
+        elif module == "thermodynamics":
+            r['thermodynamics_table'] = 2 * d * self.th.tt_size * self.th.th_size
+            r['z_table'] = d * self.th.tt_size
+        elif module == "perturb":
+            # the source functions and their second derivatives
+            n = 0
+            for md in range(self.pt.md_size):
+                n += <Py_ssize_t> self.pt.ic_size[md] * self.pt.tp_size[md] * self.pt.k_size[md]
+            r['sources'] = 2 * d * n * self.pt.tau_size
+        elif module == "primordial":
+            n = 0
+            for md in range(self.pm.md_size):
+                n += self.pm.ic_ic_size[md]
+            r['lnpk'] = 2 * d * n * self.pm.lnk_size
+        elif module == "nonlinear":
+            if self.nl.method != 0:
+                r['nl_corr_density'] = d * self.nl.k_size * self.nl.tau_size
+        elif module == "transfer":
+            n = 0
+            for md in range(self.tr.md_size):
+                n += <Py_ssize_t> self.pt.ic_size[md] * self.tr.tp_size[md] * self.tr.l_size[md]
+            r['transfer'] = d * n * self.tr.q_size
+        elif module == "spectra":
+            n = <Py_ssize_t> self.sp.ln_k_size * self.sp.ln_tau_size
+            r['ln_pk'] = 2 * d * n * self.sp.ic_ic_size[self.sp.index_md_scalars]
+            if self.nl.method != 0:
+                r['ln_pk_nl'] = 2 * d * n
+        elif module == "lensing":
+            r['cl_lens'] = 2 * d * self.le.l_size * self.le.lt_size
+        return r
+
+cdef class ParameterTemplate:
+    """
+    A set of CLASS parameters of which only a few vary, e.g. in the
+    sweeps of an emulator, to create many engines quickly.
+
+    The fixed parameters are converted to the strings read by CLASS and
+    sorted once; :func:`engine` then copies them, and only converts the
+    varying values. If all the varying parameters have a default value in
+    ``pars``, the parameters are validated by CLASS at construction.
+
+    Parameters
+    ----------
+    pars : dict
+      the CLASS parameters, including the default values of the varying
+      parameters, if any
+    varying : list of str
+      the names of the parameters that change between engines
+
+    Examples
+    --------
+    >>> pars = load_precision('pk_ref.pre')
+    >>> pars.update({'output': 'mPk', 'h': 0.67, 'Omega_cdm': 0.26})
+    >>> template = ParameterTemplate(pars, ['h', 'Omega_cdm'])
+    >>> engine = template.engine({'h': 0.7, 'Omega_cdm': 0.25})
+    """
+    def __cinit__(self, *args, **kwargs):
+        self._ready = False
+
+    def __init__(self, object pars, varying):
+        if isinstance(varying, str):
+            varying = [varying]
+        self.varying = tuple(varying)
+        self.pars = dict(pars)
+
+        # the varying parameters without a default are filled in later
+        pars = dict(pars)
+        for name in self.varying:
+            pars.setdefault(name, "")
+
+        _build_file_content(pars, &self.fc)
+        self._ready = True
+
+        self._index = {}
+        for i in range(self.fc.size):
+            name = self.fc.name[i].decode()
+            if name in self.varying:
+                self._index[name] = i
+
+        if all(name in self.pars for name in self.varying):
+            self.engine()
+
+    def __dealloc__(self):
+        if self._ready: parser_free(&self.fc)
+
+    def __reduce__(self):
+        return (ParameterTemplate, (self.pars, self.varying))
+
+    cdef _stamp(self, file_content * fc, dict values):
+        r"""
+        Copy the template to ``fc``, replacing the varying parameters with
+        ``values``; ``fc`` is freed with ``parser_free``.
+        """
+        cdef int i, n = self.fc.size
+
+        fc.size = n
+        fc.filename = <char*> malloc(sizeof(FileArg))
+        fc.name = <FileArg*> malloc(sizeof(FileArg) * n)
+        fc.value = <FileArg*> malloc(sizeof(FileArg) * n)
+        fc.read = <short*> malloc(sizeof(short) * n)
+        if fc.filename == NULL or fc.name == NULL or fc.value == NULL or fc.read == NULL:
+            raise MemoryError
+
+        strncpy(fc.filename, "NOFILE", sizeof(FileArg))
+        memcpy(fc.name, self.fc.name, sizeof(FileArg) * n)
+        memcpy(fc.value, self.fc.value, sizeof(FileArg) * n)
+        for i in range(n):
+            fc.read[i] = _FALSE_
+
+        for name in values:
+            dumcp = val2str(values[name]).encode()
+            strncpy(fc.value[<int> self._index[name]], dumcp[:sizeof(FileArg)-1], sizeof(FileArg))
+
+    def engine(self, values={}, nthreads=None):
+        r"""
+        Create a :class:`ClassEngine` from the template.
+
+        Parameters
+        ----------
+        values : dict, optional
+          the values of the varying parameters; the default values are used
+          for the missing ones
+        nthreads : int, optional
+          the number of OpenMP threads of the CLASS modules, see
+          :class:`ClassEngine`
+
+        Returns
+        -------
+        ClassEngine :
+          the engine, with the input parameters parsed
+        """
+        cdef ClassEngine engine
+
+        values = dict(values)
+        for name in values:
+            if name not in self._index:
+                raise ValueError("'%s' is not a varying parameter of the template; valid names are %s"
+                                 % (name, ', '.join(self.varying)))
+        for name in self.varying:
+            if name not in values and name not in self.pars:
+                raise ValueError("no value for the varying parameter '%s'" % name)
+
+        if nthreads is not None and nthreads < 1:
+            raise ValueError("number of threads must be at least 1")
+
+        engine = ClassEngine.__new__(ClassEngine)
+        engine.nthreads = 0 if nthreads is None else nthreads
+        engine.pars = dict(self.pars)
+        engine.pars.update(values)
+
+        self._stamp(&engine.fc, values)
+        engine.ready.fc = True
+        engine.compute('input')
+        return engine
+
 cdef class Background:
     """
     A wrapper of the `background module <https://goo.gl/SU71dn>`_ in CLASS.
 
+    The methods returning a function of redshift accept an optional
+    ``out`` array, as numpy ufuncs do, and redshifts of any float type or
+    layout. The derived quantities, e.g. :func:`Omega_m`, are computed in
+    ``out``, with one temporary per additional column. With :func:`set_float32_results`, float32 redshifts give
+    float32 results, computed in double precision.
+
     Parameters
     ----------
     engine : ClassEngine
       the CLASS engine object
-    """
-    cdef ClassEngine engine
-    cdef background * ba
-    cdef readonly dict data
+    nthreads : int, optional
+      the number of threads used to evaluate the background quantities;
+      if not given, the value set by :func:`set_num_threads` is used
 
-    cdef readonly np.ndarray Omega0_pncdm
-    """
-    The pressure contribution to the current density parameter for the
-    non-relativatistic part of massive neutrinos (an array holding all species).
-    """
-    cdef readonly double Omega0_pncdm_tot
-    """
-    The sum of :math:`\Omega_{0,pncdm}` for all species.
-    """
-    cdef readonly double H0
-    r"""
-    Current Hubble parameter in units of :math:`\mathrm{km/s} (\mathrm{Mpc}/h)^{-1}.`
-    """
-    cdef readonly double C
-    """
-    The speed of light in units of km/s.
-    """
-    cdef readonly double G
-    r"""
-    The gravitational constant in units of :math:`10^{-10} \ (M_\odot/h)^{-1} (\mathrm{Mpc}/h) \mathrm{km}^2 \mathrm{s}^{-2}`.
+    Attributes
+    ----------
+    nthreads : int
+      the number of threads used by :func:`compute_for_z`; 0 means the
+      default set by :func:`set_num_threads`
+    Omega0_pncdm : array_like
+      the pressure contribution to the current density parameter for the
+      non-relativatistic part of massive neutrinos (an array holding all
+      species)
+    Omega0_pncdm_tot : float
+      the sum of :math:`\Omega_{0,pncdm}` for all species
+    H0 : float
+      current Hubble parameter in units of :math:`\mathrm{km/s} (\mathrm{Mpc}/h)^{-1}`
+    C : float
+      the speed of light in units of km/s
+    G : float
+      the gravitational constant in units of
+      :math:`10^{-10} \ (M_\odot/h)^{-1} (\mathrm{Mpc}/h) \mathrm{km}^2 \mathrm{s}^{-2}`
     """
-
-    cdef readonly double _RHO_
-
-    def __init__(self, ClassEngine engine):
+    def __init__(self, ClassEngine engine, nthreads=None):
         self.engine = engine
         self.engine.compute("background")
         self.ba = &self.engine.ba
+        self.nthreads = 0 if nthreads is None else nthreads
 
         self.H0 = 100.  # in Mpc/h unit
         self.G = 43007.1 * 1e-3 # in 1e10 Msun/h, Mpc/h, and km/s Unit
         self.C = 2.99792458e5          #  /**< c in km/s */
 
-        # convert RHO to  1e10 Msun/h
-        self._RHO_ = 3.0 * (self.H0 / self.ba.H0) ** 2 / (8 * 3.1415927 * self.G)
+    def __reduce__(self):
+        return (Background, (self.engine, self.nthreads or None))
+
+    # the following depend on the parameters, and are derived from ba on
+    # each access, so that they follow ClassEngine.update
+
+    property _RHO_:
+        r"""
+        The factor converting the densities of CLASS to
+        :math:`10^{10} (M_\odot/h) (\mathrm{Mpc}/h)^{-3}`.
+        """
+        def __get__(self):
+            return 3.0 * (self.H0 / self.ba.H0) ** 2 / (8 * 3.1415927 * self.G)
 
-        self.Omega0_pncdm_tot = self.Omega_pncdm(0.0) # watchout, the convention is 0.0
-        self.Omega0_pncdm = np.array([self.Omega_pncdm(0.0, i) for i in range(self.N_ncdm)], np.float64)
+    property Omega0_pncdm:
+        r"""
+        The pressure contribution to the current density parameter for the
+        non-relativatistic part of massive neutrinos (an array holding all
+        species).
+        """
+        def __get__(self):
+            return np.array([self.Omega_pncdm(0.0, i) for i in range(self.N_ncdm)], np.float64)
+
+    property Omega0_pncdm_tot:
+        r"""
+        The sum of :math:`\Omega_{0,pncdm}` for all species.
+        """
+        def __get__(self):
+            return self.Omega_pncdm(0.0) # watchout, the convention is 0.0
 
     property Omega0_b:
         r"""
@@ -560,122 +1955,528 @@ cdef class Background:
             T = np.array([self.ba.T_ncdm[i] for i in range(self.N_ncdm)], dtype=np.float64)
             return T*self.ba.T_cmb # from units of photon temp to K
 
-    def T_cmb(self, z):
+    def T_cmb(self, z, out=None):
         r"""
         The CMB temperature as a function of redshift.
         """
-        return self.T0_cmb * (1 + z)
+        out = _one_plus_z(z, out)
+        out *= self.T0_cmb
+        return out
 
-    def T_ncdm(self, z):
+    def T_ncdm(self, z, out=None):
         r"""
         The ncdm temperature (massive neutrinos) as a function of redshift.
 
         Return shape is (N_ncdm,) if N_ncdm == 1 else (len(z), N_ncdm)
         """
+        T0 = np.asarray(self.T0_ncdm, dtype=np.float64)
         if np.isscalar(z):
-            return self.T0_ncdm * (1+z)
-        else:
-            z = np.array(z, ndmin=1, dtype=np.float64)
-        return self.T0_ncdm * (1 + z)[:,None]
+            return np.multiply(T0, 1 + z, out=out)
+
+        z = np.asarray(z)
+        if z.ndim == 0:
+            z = z.reshape(1)
+
+        # the rows are written once, from chunks of z
+        out = _columns_out(z, len(T0), out)
+        rows = out.reshape(-1, len(T0))
+        it = _chunks([z], nout=0)
+        with it:
+            for zc in it:
+                rows[it.iterindex:it.iterindex + zc.shape[0]] = np.multiply.outer(zc + 1., T0)
+        return out
+
+    property columns:
+        r"""
+        A dictionary mapping the names of the available columns of the
+        background vector to their CLASS index, covering all the
+        ``index_bg_*`` columns of CLASS 2.6. The columns are in CLASS
+        units, i.e., powers of :math:`\mathrm{Mpc}`.
 
-    def compute_for_z(self, z, int column):
+        These are the names accepted by :func:`evaluate`.
         """
-        Internal function to compute the background module at a specific redshift.
+        def __get__(self):
+            columns = {}
+            columns['a'] = self.ba.index_bg_a
+            columns['H'] = self.ba.index_bg_H
+            columns['H_prime'] = self.ba.index_bg_H_prime
+            columns['rho_g'] = self.ba.index_bg_rho_g
+            columns['rho_b'] = self.ba.index_bg_rho_b
+            if self.ba.has_cdm:
+                columns['rho_cdm'] = self.ba.index_bg_rho_cdm
+            if self.ba.has_lambda:
+                columns['rho_lambda'] = self.ba.index_bg_rho_lambda
+            if self.ba.has_fld:
+                columns['rho_fld'] = self.ba.index_bg_rho_fld
+                columns['w_fld'] = self.ba.index_bg_w_fld
+            if self.ba.has_ur:
+                columns['rho_ur'] = self.ba.index_bg_rho_ur
+            if self.ba.has_ncdm:
+                for i in range(self.N_ncdm):
+                    columns['rho_ncdm[%d]' % i] = self.ba.index_bg_rho_ncdm1 + i
+                    columns['p_ncdm[%d]' % i] = self.ba.index_bg_p_ncdm1 + i
+                    columns['pseudo_p_ncdm[%d]' % i] = self.ba.index_bg_pseudo_p_ncdm1 + i
+            if self.ba.has_dcdm:
+                columns['rho_dcdm'] = self.ba.index_bg_rho_dcdm
+            if self.ba.has_dr:
+                columns['rho_dr'] = self.ba.index_bg_rho_dr
+            if self.ba.has_scf:
+                columns['phi_scf'] = self.ba.index_bg_phi_scf
+                columns['phi_prime_scf'] = self.ba.index_bg_phi_prime_scf
+                columns['V_scf'] = self.ba.index_bg_V_scf
+                columns['dV_scf'] = self.ba.index_bg_dV_scf
+                columns['ddV_scf'] = self.ba.index_bg_ddV_scf
+                columns['rho_scf'] = self.ba.index_bg_rho_scf
+                columns['p_scf'] = self.ba.index_bg_p_scf
+            columns['rho_crit'] = self.ba.index_bg_rho_crit
+            columns['Omega_r'] = self.ba.index_bg_Omega_r
+            columns['Omega_m'] = self.ba.index_bg_Omega_m
+            columns['conf_distance'] = self.ba.index_bg_conf_distance
+            columns['ang_distance'] = self.ba.index_bg_ang_distance
+            columns['lum_distance'] = self.ba.index_bg_lum_distance
+            columns['time'] = self.ba.index_bg_time
+            columns['D'] = self.ba.index_bg_D
+            columns['f'] = self.ba.index_bg_f
+            columns['rs'] = self.ba.index_bg_rs
+            return columns
+
+    property background_table:
+        r"""
+        The background table of CLASS, of shape ``(bt_size, bg_size)``, as
+        a read-only view of the memory of the engine.
+
+        The columns are those listed in :attr:`columns`, in CLASS units, and
+        the rows correspond to :attr:`tau_table` and :attr:`z_table`.
+        """
+        def __get__(self):
+            return _table_view(self.ba.background_table, (self.ba.bt_size, self.ba.bg_size),
+                               self.engine, "background")
+
+    property tau_table:
+        r"""
+        The conformal time of the rows of :attr:`background_table`, in
+        :math:`\mathrm{Mpc}`, as a read-only view.
+        """
+        def __get__(self):
+            return _table_view(self.ba.tau_table, (self.ba.bt_size,), self.engine, "background")
+
+    property z_table:
+        r"""
+        The redshift of the rows of :attr:`background_table`, as a
+        read-only view.
+        """
+        def __get__(self):
+            return _table_view(self.ba.z_table, (self.ba.bt_size,), self.engine, "background")
+
+    cdef int column_at_z(self, double z, int column, double * value) nogil:
+        r"""
+        Evaluate the column ``column`` of the background vector, in CLASS
+        units, at redshift ``z``, without the GIL; see :attr:`columns` for
+        the indices.
+
+        This is part of the C-level API in ``classylss/binding.pxd``, for
+        calls from the parallel loops of other extensions. Returns
+        ``_FAILURE_`` if the evaluation failed, leaving the reason in
+        ``ba.error_message``.
+        """
+        cdef int status
+        cdef double * pvecback
+
+        # bg_size is only valid once the module is computed
+        if not self.engine.ready.ba:
+            if self.engine.require("background", self.ba.error_message) == _FAILURE_:
+                return _FAILURE_
+
+        if column < 0 or column >= self.ba.bg_size:
+            strncpy(self.ba.error_message, "background column index out of range", sizeof(ErrorMsg))
+            return _FAILURE_
+
+        pvecback = <double*> malloc(sizeof(double) * self.ba.bg_size)
+        if pvecback == NULL:
+            strncpy(self.ba.error_message, "could not allocate background workspace", sizeof(ErrorMsg))
+            return _FAILURE_
+
+        status = self._vector_at_z(z, pvecback)
+        if status == _SUCCESS_:
+            value[0] = pvecback[column]
+        free(pvecback)
+        return status
+
+    cdef int growth_at_z(self, double z, double * D, double * f) nogil:
+        r"""
+        Evaluate the scale-independent growth factor ``D`` and growth rate
+        ``f`` at redshift ``z``, without the GIL.
+
+        This is part of the C-level API in ``classylss/binding.pxd``; see
+        :func:`column_at_z`.
+        """
+        cdef int status
+        cdef double * pvecback
+
+        if not self.engine.ready.ba:
+            if self.engine.require("background", self.ba.error_message) == _FAILURE_:
+                return _FAILURE_
+
+        pvecback = <double*> malloc(sizeof(double) * self.ba.bg_size)
+        if pvecback == NULL:
+            strncpy(self.ba.error_message, "could not allocate background workspace", sizeof(ErrorMsg))
+            return _FAILURE_
+
+        status = self._vector_at_z(z, pvecback)
+        if status == _SUCCESS_:
+            D[0] = pvecback[self.ba.index_bg_D]
+            f[0] = pvecback[self.ba.index_bg_f]
+        free(pvecback)
+        return status
+
+    cdef int _vector_at_z(self, double z, double * pvecback) nogil:
+        r"""
+        Fill ``pvecback`` with the background vector at redshift ``z``,
+        recomputing the module first if the engine was updated.
         """
         cdef double tau
-        cdef int last_index #junk
+        cdef int last_index = 0
+
+        if not self.engine.ready.ba:
+            if self.engine.require("background", self.ba.error_message) == _FAILURE_:
+                return _FAILURE_
 
-        z = np.array(z, dtype=np.float64)
+        if background_tau_of_z(self.ba, z, &tau) == _FAILURE_:
+            return _FAILURE_
+        return background_at_tau(self.ba, tau, self.ba.long_info, self.ba.inter_normal,
+                                 &last_index, pvecback)
+
+    cdef int _compute_for_z(self, const double * z, Py_ssize_t zstride, Py_ssize_t size,
+                            const int * columns, int ncolumns,
+                            double * out, Py_ssize_t ostride, double scale,
+                            int monotonic, int nthreads) nogil:
+        r"""
+        Evaluate ``ncolumns`` columns of the background vector at ``size``
+        redshifts, stored every ``zstride`` values, without the GIL. The
+        results are multiplied by ``scale`` and stored row by row in
+        ``out``, with the rows ``ostride`` values apart.
+
+        The redshifts are split statically over ``nthreads`` OpenMP threads,
+        each with its own ``pvecback`` scratch buffer, and each redshift is
+        interpolated only once for all the columns. If ``monotonic`` is
+        true, the table indices found for one redshift are used as the
+        starting point for the next in both the tau-of-z and background
+        interpolations; each thread gets a contiguous chunk, so this
+        stays valid with several threads.
+
+        Returns ``_FAILURE_`` if any point failed, leaving the reason in
+        ``ba.error_message``. Each thread evaluates a copy of the structure,
+        since CLASS writes its errors there, and the first failure of the
+        first failing thread is copied back.
+        """
+        cdef Py_ssize_t i
+        cdef int j
+        cdef int status
+        cdef double tau
+        cdef int last_index
+        cdef int last_index_z
+        cdef int last_index_tau
+        cdef int nfail = 0
+        cdef double * pvecback
+        cdef background * pba
+        cdef char * slot
+        cdef char * slots = <char*> calloc(nthreads, sizeof(ErrorMsg))
+
+        with parallel(num_threads=nthreads):
+            pvecback = <double*> malloc(sizeof(double) * self.ba.bg_size)
+            pba = <background*> malloc(sizeof(background))
+            if pba != NULL:
+                memcpy(pba, self.ba, sizeof(background))
+            slot = NULL
+            if slots != NULL:
+                slot = &slots[threadid() * sizeof(ErrorMsg)]
+
+            # carried over between the redshifts of one thread
+            last_index_z = 0
+            last_index_tau = 0
+
+            for i in prange(size, schedule='static'):
+                # assigned here so that they are private to each thread
+                tau = 0.
+                last_index = 0
+                status = _FAILURE_
+
+                if pvecback == NULL or pba == NULL:
+                    pass
+                elif monotonic:
+                    status = _tau_of_z_closeby(pba, z[i*zstride], &last_index_z, &tau)
+                    if status == _SUCCESS_:
+                        status = background_at_tau(pba, tau, pba.long_info, pba.inter_closeby,
+                                                   &last_index_tau, pvecback)
+                else:
+                    status = background_tau_of_z(pba, z[i*zstride], &tau)
+                    if status == _SUCCESS_:
+                        status = background_at_tau(pba, tau, pba.long_info, pba.inter_normal,
+                                                   &last_index, pvecback)
+
+                if status == _FAILURE_:
+                    nfail += 1
+                    if pba != NULL:
+                        _record_failure(slot, pba.error_message)
+                else:
+                    for j in range(ncolumns):
+                        out[i * ostride + j] = pvecback[columns[j]] * scale
 
-        #generate a new output array of the correct shape by broadcasting input arrays together
-        out = np.empty(np.broadcast(z).shape, np.float64)
+            free(pvecback)
+            free(pba)
 
-        #generate the iterator over the input and output arrays, does the same thing as
-        # PyArray_MultiIterNew
+        if nfail > 0:
+            _first_failure(slots, nthreads, self.ba.error_message)
+        free(slots)
+        if nfail > 0:
+            return _FAILURE_
+        return _SUCCESS_
 
-        cdef np.broadcast it = np.broadcast(z, out)
+    def compute_for_z(self, z, column, monotonic=None, out=None, double scale=1.):
+        """
+        Internal function to compute the background module at a specific redshift.
 
-        cdef double [::1] pvecback = np.zeros(self.ba.bg_size, dtype='f8')
+        ``column`` is either a single CLASS index, or a list of indices, in
+        which case the columns are stacked along a new last axis.
 
-        while np.PyArray_MultiIter_NOTDONE(it):
+        If ``monotonic`` is True, ``z`` is assumed to be sorted (in either
+        order) and the table lookups start from the previous redshift; this
+        is still correct, but slower, for unsorted input. By default, this
+        is used if ``z`` is found to be sorted.
 
-            #PyArray_MultiIter_DATA is used to access the pointers the iterator points to
-            aval = (<double*>np.PyArray_MultiIter_DATA(it, 0))[0]
+        The results are multiplied by ``scale`` and written to ``out`` if
+        given; for a list of columns, ``out`` must be a C-contiguous float32
+        or float64 array. ``z`` can be of any float type and strided,
+        without a copy.
+        """
+        cdef int status = _SUCCESS_
+        cdef int nthreads = self.nthreads if self.nthreads > 0 else _num_threads
+        cdef int sorted_z
+        cdef np.ndarray zc, oc
+        cdef double * pz
+        cdef double * pout
+        cdef Py_ssize_t size, zstride, ostride, ncol
+        cdef int single = np.ndim(column) == 0
+        cdef np.ndarray work = None
+
+        columns = np.array(column, dtype=np.intc, ndmin=1).reshape(-1)
+        if ((columns < 0) | (columns >= self.ba.bg_size)).any():
+            raise ValueError("background column index out of range [0, %d)" % self.ba.bg_size)
+
+        cdef const int [::1] cols = columns
+        ncol = cols.shape[0]
+
+        if single:
+            it = _chunks([z, out])
+        else:
+            # the columns of one redshift are written next to each other;
+            # a float32 output is written from a float64 chunk
+            z = np.asarray(z)
+            out = _columns_out(z, ncol, out)
+            rows = out.reshape(-1, ncol)
+            it = _chunks([z], nout=0)
+
+        with it:
+            for chunk in it:
+                if single:
+                    zc, oc = chunk
+                    pout = _chunk_data(oc)
+                    ostride = _chunk_stride(oc)
+                else:
+                    zc = chunk
+                    if out.dtype == np.float64:
+                        pout = <double*> np.PyArray_DATA(out) + it.iterindex * ncol
+                    else:
+                        if work is None or work.shape[0] < zc.shape[0]:
+                            work = np.empty((zc.shape[0], ncol), np.float64)
+                        pout = <double*> np.PyArray_DATA(work)
+                    ostride = ncol
+
+                pz = _chunk_data(zc)
+                zstride = _chunk_stride(zc)
+                size = zc.shape[0]
+
+                if monotonic is None:
+                    with nogil:
+                        sorted_z = _is_monotonic(pz, zstride, size)
+                else:
+                    sorted_z = bool(monotonic)
 
-            if background_tau_of_z(self.ba,aval, &tau)==_FAILURE_:
-                raise ClassRuntimeError(self.ba.error_message.decode())
+                with nogil:
+                    status = self._compute_for_z(pz, zstride, size, &cols[0], ncol,
+                                                 pout, ostride, scale, sorted_z, nthreads)
 
-            if background_at_tau(self.ba,tau,self.ba.long_info,self.ba.inter_normal,&last_index, &pvecback[0])==_FAILURE_:
-                raise ClassRuntimeError(self.ba.error_message.decode())
+                if status == _FAILURE_:
+                    raise ClassRuntimeError(self.ba.error_message.decode())
 
-            (<double*>(np.PyArray_MultiIter_DATA(it, 1)))[0] = pvecback[column]
+                if not single and out.dtype != np.float64:
+                    rows[it.iterindex:it.iterindex + size] = work[:size]
 
-            #PyArray_MultiIter_NEXT is used to advance the iterator
-            np.PyArray_MultiIter_NEXT(it)
+            if single:
+                out = it.operands[1]
 
         return out
 
-    def Omega_pncdm(self, z, species=None):
+    def evaluate(self, z, columns=None):
+        r"""
+        Compute several columns of the background vector at once, with a
+        single interpolation of the background tables per redshift.
+
+        Parameters
+        ----------
+        z : float, array_like
+          the redshift values
+        columns : list of str, optional
+          the names of the columns to compute, as listed in :attr:`columns`;
+          by default all columns are returned
+
+        Returns
+        -------
+        array_like :
+          structured array of the same shape as ``z``, with one field per
+          column, in CLASS units
+        """
+        available = self.columns
+        if columns is None:
+            columns = list(available)
+        elif isinstance(columns, str):
+            columns = [columns]
+
+        for name in columns:
+            if name not in available:
+                raise ValueError("unknown background column '%s'; valid names are %s"
+                                 % (name, ', '.join(available)))
+
+        data = self.compute_for_z(z, [available[name] for name in columns])
+        dtype = np.dtype([(str(name), data.dtype) for name in columns])
+        return data.view(dtype).reshape(data.shape[:-1])
+
+    def as_ufunc(self, column, double scale=1.):
+        r"""
+        Return a numpy ufunc evaluating one column of the background vector
+        as a function of redshift.
+
+        The ufunc has float64 and float32 loops and supports the usual ufunc
+        arguments (``out``, ``where``, ``dtype``), e.g., for use with
+        ``dask.array.map_blocks``. It holds a reference to the engine, and
+        follows :func:`ClassEngine.update`. Redshifts out of the range of
+        the background tables give NaN.
+
+        Parameters
+        ----------
+        column : str or int
+          the name of the column, as listed in :attr:`columns`, or its
+          CLASS index
+        scale : float, optional
+          a factor multiplying the column, e.g. to convert the CLASS units
+
+        Returns
+        -------
+        numpy.ufunc :
+          the ufunc ``f(z)``
+        """
+        if isinstance(column, str):
+            available = self.columns
+            if column not in available:
+                raise ValueError("unknown background column '%s'; valid names are %s"
+                                 % (column, ', '.join(available)))
+            name = column
+            column = available[column]
+        else:
+            name = "column_%d" % column
+        if column < 0 or column >= self.ba.bg_size:
+            raise ValueError("background column index out of range [0, %d)" % self.ba.bg_size)
+
+        cdef _UFuncKernel kern = _UFuncKernel(self.engine, "background")
+        kern.kern.column = column
+        kern.kern.scale = scale
+        return _make_ufunc(kern, _ufunc_background_loops, 1, name,
+                           "the background column %s as a function of z" % name)
+
+    def Omega_pncdm(self, z, species=None, out=None):
         r"""
         Return :math:`\Omega_{pncdm}` as a function redshift.
         """
-        return 3 * self.p_ncdm(z, species) / self.rho_tot(z)
+        z = _unaliased(z, out)
+        out = self.p_ncdm(z, species, out=out)
+        out *= 3
+        out /= self.rho_tot(z)
+        return out
+
+    def _sum_species(self, func, z, out):
+        r"""
+        The sum of ``func(z, species, out)`` over the ncdm species,
+        accumulated in ``out``.
+        """
+        if self.N_ncdm == 0:
+            return self.compute_for_z(z, self.ba.index_bg_a, out=out, scale=0.)
+        z = _unaliased(z, out)
+        out = func(z, 0, out=out)
+        for i in range(1, self.N_ncdm):
+            out += func(z, i)
+        return out
 
-    def rho_g(self, z):
+    def rho_g(self, z, out=None):
         r"""
         Density of photons :math:`\rho_g` as a function of redshift, in
         units of :math:`10^{10} (M_\odot/h) (\mathrm{Mpc}/h)^{-3}`.
         """
-        return self.compute_for_z(z, self.ba.index_bg_rho_g) * self._RHO_
+        return self.compute_for_z(z, self.ba.index_bg_rho_g, out=out, scale=self._RHO_)
 
-    def rho_b(self, z):
+    def rho_b(self, z, out=None):
         r"""
         Density of baryons :math:`\rho_b` as a function of redshift, in
         units of :math:`10^{10} (M_\odot/h) (\mathrm{Mpc}/h)^{-3}`.
         """
-        return self.compute_for_z(z, self.ba.index_bg_rho_b) * self._RHO_
+        return self.compute_for_z(z, self.ba.index_bg_rho_b, out=out, scale=self._RHO_)
 
-    def rho_m(self, z):
+    def rho_m(self, z, out=None):
         r"""
         Density of matter :math:`\rho_b` as a function of redshift, in
         units of :math:`10^{10} (M_\odot/h) (\mathrm{Mpc}/h)^{-3}`.
         """
-        return self.compute_for_z(z, self.ba.index_bg_Omega_m) * self.rho_tot(z)
+        z = _unaliased(z, out)
+        out = self.compute_for_z(z, self.ba.index_bg_Omega_m, out=out)
+        out *= self.rho_tot(z)
+        return out
 
-    def rho_r(self, z):
+    def rho_r(self, z, out=None):
         r"""
         Density of radiation :math:`\rho_r` as a function of redshift, in
         units of :math:`10^{10} (M_\odot/h) (\mathrm{Mpc}/h)^{-3}`.
         """
-        return self.compute_for_z(z, self.ba.index_bg_Omega_r) * self.rho_tot(z)
+        z = _unaliased(z, out)
+        out = self.compute_for_z(z, self.ba.index_bg_Omega_r, out=out)
+        out *= self.rho_tot(z)
+        return out
 
-    def rho_cdm(self, z):
+    def rho_cdm(self, z, out=None):
         r"""
         Density of cold dark matter :math:`\rho_{cdm}` as a function of redshift,
         in units of :math:`10^{10} (M_\odot/h) (\mathrm{Mpc}/h)^{-3}`.
         """
-        return self.compute_for_z(z, self.ba.index_bg_rho_cdm) * self._RHO_
+        return self.compute_for_z(z, self.ba.index_bg_rho_cdm, out=out, scale=self._RHO_)
 
-    def rho_ur(self, z):
+    def rho_ur(self, z, out=None):
         r"""
         Density of ultra-relativistic radiation (massless neutrinos)
         :math:`\rho_{ur}` as a function of redshift, in units of
         :math:`10^{10} (M_\odot/h) (\mathrm{Mpc}/h)^{-3}`.
         """
-        return self.compute_for_z(z, self.ba.index_bg_rho_ur) * self._RHO_
+        return self.compute_for_z(z, self.ba.index_bg_rho_ur, out=out, scale=self._RHO_)
 
-    def rho_ncdm(self, z, species=None):
+    def rho_ncdm(self, z, species=None, out=None):
         r"""
         Density of non-relativistic part of massive neutrinos :math:`\rho_{ncdm}`
         as a function of redshift, in units of
         :math:`10^{10} (M_\odot/h) (\mathrm{Mpc}/h)^{-3}`.
         """
         if species is None:
-            return sum(self.rho_ncdm(z, species=i) for i in range(self.N_ncdm))
+            return self._sum_species(self.rho_ncdm, z, out)
         assert species < self.N_ncdm and species >= 0
-        return self.compute_for_z(z, self.ba.index_bg_rho_ncdm1 + species) * self._RHO_
+        return self.compute_for_z(z, self.ba.index_bg_rho_ncdm1 + species, out=out, scale=self._RHO_)
 
-    def rho_crit(self, z):
+    def rho_crit(self, z, out=None):
         r"""
         Critical density excluding curvature :math:`\rho_c` as a function of
         redshift, in units of :math:`10^{10} (M_\odot/h) (\mathrm{Mpc}/h)^{-3}`.
@@ -686,9 +2487,9 @@ cdef class Background:
 
               \rho_c(z) = \frac{3 H(z)^2}{8 \pi G}.
         """
-        return self.compute_for_z(z, self.ba.index_bg_rho_crit) * self._RHO_
+        return self.compute_for_z(z, self.ba.index_bg_rho_crit, out=out, scale=self._RHO_)
 
-    def rho_k(self, z):
+    def rho_k(self, z, out=None):
         r"""
         Density of curvature :math:`\rho_k` as a function of redshift, in
         units of :math:`10^{10} (M_\odot/h) (\mathrm{Mpc}/h)^{-3}`.
@@ -699,118 +2500,154 @@ cdef class Background:
 
             \rho_\mathrm{crit} = \rho_\mathrm{tot} + \rho_k
         """
-        z = np.array(z, dtype=np.float64)
-        return -self.ba.K * ( z+1.) ** 2 * self._RHO_
+        out = _one_plus_z(z, out)
+        np.square(out, out=out)
+        out *= -self.ba.K * self._RHO_
+        return out
 
-    def rho_tot(self, z):
+    def rho_tot(self, z, out=None):
         r"""
         Total density :math:`\rho_\mathrm{tot}` as a function of redshift, in
         units of :math:`10^{10} (M_\odot/h) (\mathrm{Mpc}/h)^{-3}`. It is usually
         close to 27.76.
         """
-        return self.rho_crit(z) - self.rho_k(z)
+        z = _unaliased(z, out)
+        out = self.rho_crit(z, out=out)
+        out -= self.rho_k(z)
+        return out
 
-    def rho_fld(self, z):
+    def rho_fld(self, z, out=None):
         r"""
         Density of dark energy fluid :math:`\rho_{fld}` as a function of
         redshift, in units of :math:`10^{10} (M_\odot/h) (\mathrm{Mpc}/h)^{-3}`.
         """
         if self.ba.has_fld:
-            return self.compute_for_z(z, self.ba.index_bg_rho_fld) * self._RHO_
+            return self.compute_for_z(z, self.ba.index_bg_rho_fld, out=out, scale=self._RHO_)
         else:
             # return zeros of the right shape
-            return self.compute_for_z(z, self.ba.index_bg_a) * 0.0
+            return self.compute_for_z(z, self.ba.index_bg_a, out=out, scale=0.)
 
-    def rho_lambda(self, z):
+    def rho_lambda(self, z, out=None):
         r"""
         Density of cosmological constant :math:`\rho_\Lambda` as a function of
         redshift, in units of :math:`10^{10} (M_\odot/h) (\mathrm{Mpc}/h)^{-3}`.
         """
         if self.ba.has_lambda:
-            return self.compute_for_z(z, self.ba.index_bg_rho_lambda) * self._RHO_
+            return self.compute_for_z(z, self.ba.index_bg_rho_lambda, out=out, scale=self._RHO_)
         else:
             # return zeros of the right shape
-            return self.compute_for_z(z, self.ba.index_bg_a) * 0.0
+            return self.compute_for_z(z, self.ba.index_bg_a, out=out, scale=0.)
 
-    def p_ncdm(self, z, species=None):
+    def p_ncdm(self, z, species=None, out=None):
         r"""
         Pressure of non-relative part of massive neutrino.
         """
         if species is None:
-            return sum(self.p_ncdm(z, i) for i in range(self.N_ncdm))
+            return self._sum_species(self.p_ncdm, z, out)
 
         assert species < self.N_ncdm and species >= 0
-        return self.compute_for_z(z, self.ba.index_bg_p_ncdm1 + species) * self._RHO_
+        return self.compute_for_z(z, self.ba.index_bg_p_ncdm1 + species, out=out, scale=self._RHO_)
 
-    def Omega_r(self, z):
+    def Omega_r(self, z, out=None):
         r"""
         Density parameter of relativistic (radiation-like) component, including
         relativistic part of massive neutrino and massless neutrino.
         """
-        return self.rho_r(z) / self.rho_crit(z)
+        z = _unaliased(z, out)
+        out = self.rho_r(z, out=out)
+        out /= self.rho_crit(z)
+        return out
 
-    def Omega_m(self, z):
+    def Omega_m(self, z, out=None):
         r"""
         Density parameter of non-relativistic (matter-like) component, including
         non-relativistic part of massive neutrino. Unit
         """
-        return self.rho_m(z) / self.rho_crit(z)
+        z = _unaliased(z, out)
+        out = self.rho_m(z, out=out)
+        out /= self.rho_crit(z)
+        return out
 
-    def Omega_g(self, z):
+    def Omega_g(self, z, out=None):
         r"""
         Density parameter of photons.
         """
-        return self.rho_g(z) / self.rho_crit(z)
+        z = _unaliased(z, out)
+        out = self.rho_g(z, out=out)
+        out /= self.rho_crit(z)
+        return out
 
-    def Omega_b(self, z):
+    def Omega_b(self, z, out=None):
         r"""
         Density parameter of baryons.
         """
-        return self.rho_b(z) / self.rho_crit(z)
+        z = _unaliased(z, out)
+        out = self.rho_b(z, out=out)
+        out /= self.rho_crit(z)
+        return out
 
-    def Omega_cdm(self, z):
+    def Omega_cdm(self, z, out=None):
         r"""
         Density parameter of cold dark matter.
         """
-        return self.rho_cdm(z) / self.rho_crit(z)
+        z = _unaliased(z, out)
+        out = self.rho_cdm(z, out=out)
+        out /= self.rho_crit(z)
+        return out
 
-    def Omega_k(self, z):
+    def Omega_k(self, z, out=None):
         r"""
         Density parameter of curvature.
         """
-        return 1 - self.rho_tot(z)/self.rho_crit(z)
+        z = _unaliased(z, out)
+        out = self.rho_tot(z, out=out)
+        out /= self.rho_crit(z)
+        np.subtract(1., out, out=out)
+        return out
 
-    def Omega_ur(self, z):
+    def Omega_ur(self, z, out=None):
         r"""
         Density parameter of ultra relativistic neutrinos.
         """
-        return self.rho_ur(z) / self.rho_crit(z)
+        z = _unaliased(z, out)
+        out = self.rho_ur(z, out=out)
+        out /= self.rho_crit(z)
+        return out
 
-    def Omega_ncdm(self, z, species=None):
+    def Omega_ncdm(self, z, species=None, out=None):
         r"""
         Density parameter of massive neutrinos.
         """
-        return self.rho_ncdm(z, species) / self.rho_crit(z)
+        z = _unaliased(z, out)
+        out = self.rho_ncdm(z, species, out=out)
+        out /= self.rho_crit(z)
+        return out
 
-    def Omega_fld(self, z):
+    def Omega_fld(self, z, out=None):
         r"""
         Density parameter of dark energy (fluid).
         """
-        return self.rho_fld(z) / self.rho_crit(z)
+        z = _unaliased(z, out)
+        out = self.rho_fld(z, out=out)
+        out /= self.rho_crit(z)
+        return out
 
-    def Omega_lambda(self, z):
+    def Omega_lambda(self, z, out=None):
         r"""
         Density of dark energy (cosmological constant).
         """
-        return self.rho_lambda(z) / self.rho_crit(z)
+        z = _unaliased(z, out)
+        out = self.rho_lambda(z, out=out)
+        out /= self.rho_crit(z)
+        return out
 
-    def time(self, z):
+    def time(self, z, out=None):
         r"""
         Proper time (age of universe) in gigayears.
         """
-        return self.compute_for_z(z, self.ba.index_bg_time) / _Gyr_over_Mpc_
+        return self.compute_for_z(z, self.ba.index_bg_time, out=out, scale=1. / _Gyr_over_Mpc_)
 
-    def comoving_distance(self, z):
+    def comoving_distance(self, z, out=None):
         r"""
         Comoving line-of-sight distance in :math:`\mathrm{Mpc}/h` at a given
         redshift.
@@ -822,47 +2659,51 @@ cdef class Background:
         See eq. 15 of `astro-ph/9905116 <https://arxiv.org/abs/astro-ph/9905116>`_
         for :math:`D_C(z)`.
         """
-        return self.compute_for_z(z, self.ba.index_bg_conf_distance) * self.ba.h
+        return self.compute_for_z(z, self.ba.index_bg_conf_distance, out=out, scale=self.ba.h)
 
-    def tau(self, z):
+    def tau(self, z, out=None):
         r"""
         Conformal time, equal to comoving distance when K = 0.0
         (flat universe). In units of :math:`\mathrm{Mpc}` as in CLASS.
         """
-        return self.compute_for_z(z, self.ba.index_bg_conf_distance)
+        return self.compute_for_z(z, self.ba.index_bg_conf_distance, out=out)
 
-    def hubble_function(self, z):
+    def hubble_function(self, z, out=None):
         r"""
         The Hubble function in CLASS units, returning ``ba.index_bg_H``.
 
         Users should use :func:`efunc` instead.
         """
-        return self.compute_for_z(z, self.ba.index_bg_H)
+        return self.compute_for_z(z, self.ba.index_bg_H, out=out)
 
-    def hubble_function_prime(self, z):
+    def hubble_function_prime(self, z, out=None):
         r"""
         Derivative of Hubble function: :math:`dH/d\tau`, where
         :math:`d\tau/da = 1 / (a^2 H)` in CLASS units.
 
         Users should use :func:`efunc_prime` instead.
         """
-        return self.compute_for_z(z, self.ba.index_bg_H_prime)
+        return self.compute_for_z(z, self.ba.index_bg_H_prime, out=out)
 
-    def efunc(self, z):
+    def efunc(self, z, out=None):
         r"""
         Function giving :math:`E(z)`, where the Hubble parameter is defined as
         :math:`H(z) = H_0 E(z)`.
         """
-        return self.hubble_function(z) / self.ba.H0
+        return self.compute_for_z(z, self.ba.index_bg_H, out=out, scale=1. / self.ba.H0)
 
-    def efunc_prime(self, z):
+    def efunc_prime(self, z, out=None):
         r"""
         Function giving :math:`dE(z) / da`.
         """
-        dtau_da = (1 + z)**2 / self.hubble_function(z)
-        return self.hubble_function_prime(z) / self.ba.H0 * dtau_da
+        z = _unaliased(z, out)
+        # dE/dtau * dtau/da, with dtau/da = (1 + z)^2 / H
+        out = self.compute_for_z(z, self.ba.index_bg_H_prime, out=out, scale=1. / self.ba.H0)
+        out /= self.hubble_function(z)
+        out *= np.square(_one_plus_z(z, None))
+        return out
 
-    def luminosity_distance(self, z):
+    def luminosity_distance(self, z, out=None):
         r"""
         Luminosity distance in :math:`\mathrm{Mpc}/h` at redshift ``z``.
 
@@ -875,9 +2716,9 @@ cdef class Background:
         See eq. 21 of `astro-ph/9905116 <https://arxiv.org/abs/astro-ph/9905116>`_
         for :math:`D_L(z)`.
         """
-        return self.compute_for_z(z, self.ba.index_bg_lum_distance) * self.ba.h
+        return self.compute_for_z(z, self.ba.index_bg_lum_distance, out=out, scale=self.ba.h)
 
-    def angular_diameter_distance(self, z):
+    def angular_diameter_distance(self, z, out=None):
         r"""
         Angular diameter distance in :math:`\mathrm{Mpc}/h` at a given redshift.
 
@@ -890,9 +2731,9 @@ cdef class Background:
         See eq. 18 of `astro-ph/9905116 <https://arxiv.org/abs/astro-ph/9905116>`_
         for :math:`D_A(z)`.
         """
-        return self.compute_for_z(z, self.ba.index_bg_ang_distance) * self.ba.h
+        return self.compute_for_z(z, self.ba.index_bg_ang_distance, out=out, scale=self.ba.h)
 
-    def comoving_transverse_distance(self, z):
+    def comoving_transverse_distance(self, z, out=None):
         r"""
         Comoving transverse distance in :math:`\mathrm{Mpc}/h` at a given
         redshift.
@@ -904,21 +2745,26 @@ cdef class Background:
         See eq. 16 of `astro-ph/9905116 <https://arxiv.org/abs/astro-ph/9905116>`_
         for :math:`D_M(z)`.
         """
-        # comoving distance if flat (in Mpc)
-        toret = self.comoving_distance(z) / self.ba.h
+        # comoving distance if flat (in Mpc/h)
+        out = self.comoving_distance(z, out=out)
 
         # positive curvature
         if (self.ba.sgnK == 1):
-            toret = np.sin(np.sqrt(self.ba.K)*toret)/np.sqrt(self.ba.K)
+            sqrtK = np.sqrt(self.ba.K)
+            out *= sqrtK / self.ba.h
+            np.sin(out, out=out)
+            out *= self.ba.h / sqrtK
 
         # negative curvature
         if (self.ba.sgnK == -1):
-            toret = np.sinh(np.sqrt(-self.ba.K)*toret)/np.sqrt(-self.ba.K)
+            sqrtK = np.sqrt(-self.ba.K)
+            out *= sqrtK / self.ba.h
+            np.sinh(out, out=out)
+            out *= self.ba.h / sqrtK
 
-        # in Mpc/h
-        return toret * self.ba.h
+        return out
 
-    def scale_independent_growth_factor(self, z):
+    def scale_independent_growth_factor(self, z, out=None):
         r"""
         Return the scale invariant growth factor :math:`D(a)` for CDM
         perturbations.
@@ -926,9 +2772,9 @@ cdef class Background:
         This is the quantity defined by CLASS as ``index_bg_D`` in the
         background module.
         """
-        return self.compute_for_z(z, self.ba.index_bg_D)
+        return self.compute_for_z(z, self.ba.index_bg_D, out=out)
 
-    def scale_independent_growth_rate(self, z):
+    def scale_independent_growth_rate(self, z, out=None):
         r"""
         The scale invariant growth rate :math:`d\mathrm{ln}D/d\mathrm{ln}a` for
         CDM perturbations.
@@ -936,7 +2782,321 @@ cdef class Background:
         This is the quantity defined by CLASS as ``index_bg_f`` in the
         background module.
         """
-        return self.compute_for_z(z, self.ba.index_bg_f)
+        return self.compute_for_z(z, self.ba.index_bg_f, out=out)
+
+cdef class FastBackground:
+    r"""
+    Cubic spline tables of the background distance, expansion and growth,
+    built once from a :class:`Background` and much faster to evaluate on
+    large arrays.
+
+    The comoving distance, Hubble function, growth factor, growth rate and
+    time are resampled onto a uniform grid in :math:`\ln a`, between
+    ``z_max`` and :attr:`Background.a_max`, and evaluated with a
+    branch-free cubic kernel. The inverse of the comoving distance is
+    tabulated as well, see :func:`z_of_comoving_distance`.
+
+    Parameters
+    ----------
+    background : Background
+      the background to tabulate
+    z_max : float, optional
+      the largest redshift of the tables
+    size : int, optional
+      the number of nodes of the tables
+    nthreads : int, optional
+      the number of threads used to evaluate the splines; if not given,
+      the value set by :func:`set_num_threads` is used
+
+    Attributes
+    ----------
+    h : float
+      the dimensionless Hubble parameter
+    H0 : float
+      the Hubble parameter today, in CLASS units
+    z_min, z_max : float
+      the smallest and largest redshift of the tables
+    size : int
+      the number of nodes of the tables
+    table : array_like
+      the tabulated quantities, of shape ``(5, size)``, in the units of the
+      corresponding methods
+    inverse : array_like
+      :math:`\ln(1+z)` tabulated on a uniform grid in comoving distance
+    nthreads : int
+      the number of threads used by the evaluation; 0 means the default
+      set by :func:`set_num_threads`
+    """
+    def __init__(self, Background background, double z_max=100., Py_ssize_t size=4096, nthreads=None):
+        cdef background * ba = background.ba
+
+        if size < 8:
+            raise ValueError("the tables need at least 8 nodes")
+        if z_max > ba.z_table[0]:
+            raise ValueError("z_max is larger than the range of the background tables, %g" % ba.z_table[0])
+
+        self.nthreads = 0 if nthreads is None else nthreads
+        self.h = ba.h
+        self.H0 = ba.H0
+
+        # the background tables end at a_max, i.e., possibly at z < 0
+        self.z_min = ba.z_table[ba.bt_size-1]
+        self.z_max = z_max
+        self.size = size
+
+        x = np.linspace(-np.log1p(self.z_max), -np.log1p(self.z_min), size)
+        z = np.clip(np.expm1(-x), self.z_min, self.z_max)
+
+        # sorted redshifts, so one interpolation per node with the closeby search
+        r = background.evaluate(z, ['conf_distance', 'H', 'D', 'f', 'time'])
+
+        table = np.empty((_FB_SIZE_, size), dtype=np.float64)
+        table[_FB_DISTANCE_] = r['conf_distance'] * self.h
+        table[_FB_HUBBLE_] = r['H']
+        table[_FB_GROWTH_FACTOR_] = r['D']
+        table[_FB_GROWTH_RATE_] = r['f']
+        table[_FB_TIME_] = r['time'] / _Gyr_over_Mpc_
+
+        self._setup_forward(x[0], x[1] - x[0], table)
+        self._setup_inverse()
+
+    property state:
+        r"""
+        A dict with the scalars and the tables of the splines, from which
+        :func:`from_state` rebuilds the object without a :class:`Background`.
+        """
+        def __get__(self):
+            return dict(h=self.h, H0=self.H0, z_min=self.z_min, z_max=self.z_max,
+                        x0=self.x0, dx=self.dx, d0=self.d0, dd=self.dd,
+                        table=self.table, table2=self.table2,
+                        inverse=self.inverse, inverse2=self.inverse2)
+
+    def __reduce__(self):
+        return (_rebuild_from_state, (FastBackground, self.state, self.nthreads))
+
+    @staticmethod
+    def from_state(dict state, nthreads=None):
+        r"""
+        Rebuild a :class:`FastBackground` from its :attr:`state`.
+
+        The tables are not copied, so they can be e.g. memory-mapped
+        read-only arrays shared between processes.
+        """
+        cdef FastBackground self = FastBackground.__new__(FastBackground)
+
+        self.nthreads = 0 if nthreads is None else nthreads
+        self.h = state['h']
+        self.H0 = state['H0']
+        self.z_min = state['z_min']
+        self.z_max = state['z_max']
+        self.x0 = state['x0']
+        self.dx = state['dx']
+        self.d0 = state['d0']
+        self.dd = state['dd']
+
+        table = np.ascontiguousarray(state['table'], dtype=np.float64)
+        inverse = np.ascontiguousarray(state['inverse'], dtype=np.float64)
+        if table.ndim != 2 or table.shape[0] != _FB_SIZE_ or table.shape[1] < 8:
+            raise ValueError("the background tables have a wrong shape")
+        self.size = table.shape[1]
+        if inverse.shape != (self.size,):
+            raise ValueError("the inverse table has a wrong shape")
+
+        self._set_tables(table, np.ascontiguousarray(state['table2'], dtype=np.float64),
+                         inverse, np.ascontiguousarray(state['inverse2'], dtype=np.float64))
+        return self
+
+    cdef _set_tables(self, np.ndarray table, np.ndarray table2,
+                     np.ndarray inverse, np.ndarray inverse2):
+        r"""
+        Point the evaluation at the given C-contiguous tables.
+        """
+        if table2.shape[0] != table.shape[0] or table2.shape[1] != table.shape[1] \
+            or inverse2.shape[0] != inverse.shape[0]:
+            raise ValueError("shape mismatch between the tables and their spline coefficients")
+
+        self.table = table
+        self.table2 = table2
+        self.inverse = inverse
+        self.inverse2 = inverse2
+        self._table = <double*> table.data
+        self._table2 = <double*> table2.data
+        self._inverse = <double*> inverse.data
+        self._inverse2 = <double*> inverse2.data
+
+    cdef _setup_forward(self, double x0, double dx, np.ndarray table):
+        r"""
+        Store the forward tables and compute their spline coefficients.
+        """
+        cdef int j
+        cdef double [::1] work = np.empty(self.size, dtype=np.float64)
+        cdef double [::1] x = x0 + dx * np.arange(self.size, dtype=np.float64)
+
+        self.x0 = x0
+        self.dx = dx
+        self.table = np.ascontiguousarray(table, dtype=np.float64)
+        self.table2 = np.empty_like(self.table)
+        self._table = <double*> self.table.data
+        self._table2 = <double*> self.table2.data
+
+        for j in range(_FB_SIZE_):
+            _spline_coefficients(&x[0], self._table + j * self.size, self.size, 1,
+                                 self._table2 + j * self.size, &work[0])
+
+    cdef _setup_inverse(self):
+        r"""
+        Tabulate :math:`\ln(1+z)` on a uniform grid in comoving distance,
+        by inverting the forward spline with a few Newton iterations.
+        """
+        cdef Py_ssize_t i
+        cdef int it
+        cdef double u, w, h2_6 = self.dx * self.dx / 6.
+        cdef const double * y = self._table + _FB_DISTANCE_ * self.size
+        cdef const double * y2 = self._table2 + _FB_DISTANCE_ * self.size
+
+        # the comoving distance decreases with ln a
+        forward = self.table[_FB_DISTANCE_]
+        d = np.linspace(forward[-1], forward[0], self.size)
+        lnz1 = -(self.x0 + self.dx * np.arange(self.size))
+
+        cdef double [::1] dist = d
+        cdef double [::1] inverse = np.interp(d, forward[::-1], lnz1[::-1])
+
+        for i in range(self.size):
+            w = inverse[i]
+            for it in range(4):
+                u = (-w - self.x0) / self.dx
+                w += (_splint_uniform(y, y2, self.size, u, h2_6) - dist[i]) / \
+                     _splint_uniform_deriv(y, y2, self.size, u, self.dx)
+            inverse[i] = min(max(w, lnz1[-1]), lnz1[0])
+
+        cdef double [::1] work = np.empty(self.size, dtype=np.float64)
+
+        self.d0 = d[0]
+        self.dd = d[1] - d[0]
+        inverse2 = np.empty(self.size, dtype=np.float64)
+
+        _spline_coefficients(&dist[0], &inverse[0], self.size, 1,
+                             <double*> np.PyArray_DATA(inverse2), &work[0])
+        self._set_tables(self.table, self.table2, np.asarray(inverse), inverse2)
+
+    cdef Py_ssize_t _evaluate_many(self, const double * x, Py_ssize_t xstride, Py_ssize_t size,
+                                   int column, double * out, Py_ssize_t ostride, int nthreads) nogil:
+        r"""
+        Evaluate ``column`` of the tables at ``size`` redshifts, or the
+        inverse table at ``size`` distances if ``column`` is
+        ``_FB_INVERSE_``, stored every ``xstride`` and ``ostride`` values,
+        without the GIL.
+
+        Returns the number of points outside of the tables; their values
+        are clamped to the ends of the tables.
+        """
+        cdef Py_ssize_t i
+        cdef Py_ssize_t nbad = 0
+        cdef Py_ssize_t n = self.size
+        cdef const double * y
+        cdef const double * y2
+        cdef double origin, scale, h2_6, u
+        cdef double lo = -_SPLINE_RANGE_TOL_
+        cdef double hi = n - 1 + _SPLINE_RANGE_TOL_
+        cdef int inverse = column == _FB_INVERSE_
+
+        if inverse:
+            y = self._inverse
+            y2 = self._inverse2
+            origin = self.d0
+            scale = 1. / self.dd
+            h2_6 = self.dd * self.dd / 6.
+        else:
+            y = self._table + column * n
+            y2 = self._table2 + column * n
+            origin = self.x0
+            scale = 1. / self.dx
+            h2_6 = self.dx * self.dx / 6.
+
+        if inverse:
+            for i in prange(size, schedule='static', num_threads=nthreads):
+                u = (x[i*xstride] - origin) * scale
+                nbad += not ((u >= lo) & (u <= hi))
+                out[i*ostride] = expm1(_splint_uniform(y, y2, n, u, h2_6))
+        else:
+            for i in prange(size, schedule='static', num_threads=nthreads):
+                u = (-log1p(x[i*xstride]) - origin) * scale
+                nbad += not ((u >= lo) & (u <= hi))
+                out[i*ostride] = _splint_uniform(y, y2, n, u, h2_6)
+
+        return nbad
+
+    def _evaluate(self, x, int column, out=None):
+        cdef Py_ssize_t nbad = 0
+        cdef int nthreads = self.nthreads if self.nthreads > 0 else _num_threads
+        cdef np.ndarray xc, oc
+
+        it = _chunks([x, out])
+        with it:
+            for xc, oc in it:
+                with nogil:
+                    nbad += self._evaluate_many(_chunk_data(xc), _chunk_stride(xc), xc.shape[0], column,
+                                                _chunk_data(oc), _chunk_stride(oc), nthreads)
+            out = it.operands[1]
+
+        if nbad > 0:
+            if column == _FB_INVERSE_:
+                raise ValueError("%d distance(s) out of the range of the tables [%g, %g]"
+                                 % (nbad, self.d0, self.d0 + self.dd * (self.size - 1)))
+            raise ValueError("%d redshift(s) out of the range of the tables [%g, %g]"
+                             % (nbad, self.z_min, self.z_max))
+        return out
+
+    def comoving_distance(self, z, out=None):
+        r"""
+        Comoving line-of-sight distance in :math:`\mathrm{Mpc}/h` at a given
+        redshift; see :func:`Background.comoving_distance`.
+        """
+        return self._evaluate(z, _FB_DISTANCE_, out)
+
+    def hubble_function(self, z, out=None):
+        r"""
+        The Hubble function in CLASS units; see
+        :func:`Background.hubble_function`.
+        """
+        return self._evaluate(z, _FB_HUBBLE_, out)
+
+    def efunc(self, z, out=None):
+        r"""
+        Function giving :math:`E(z)`, where the Hubble parameter is defined as
+        :math:`H(z) = H_0 E(z)`.
+        """
+        out = self._evaluate(z, _FB_HUBBLE_, out)
+        out /= self.H0
+        return out
+
+    def scale_independent_growth_factor(self, z, out=None):
+        r"""
+        The scale invariant growth factor :math:`D(a)`; see
+        :func:`Background.scale_independent_growth_factor`.
+        """
+        return self._evaluate(z, _FB_GROWTH_FACTOR_, out)
+
+    def scale_independent_growth_rate(self, z, out=None):
+        r"""
+        The scale invariant growth rate :math:`d\mathrm{ln}D/d\mathrm{ln}a`; see
+        :func:`Background.scale_independent_growth_rate`.
+        """
+        return self._evaluate(z, _FB_GROWTH_RATE_, out)
+
+    def time(self, z, out=None):
+        r"""
+        Proper time (age of universe) in gigayears.
+        """
+        return self._evaluate(z, _FB_TIME_, out)
+
+    def z_of_comoving_distance(self, d, out=None):
+        r"""
+        The redshift at a given comoving line-of-sight distance, in
+        :math:`\mathrm{Mpc}/h`; the inverse of :func:`comoving_distance`.
+        """
+        return self._evaluate(d, _FB_INVERSE_, out)
 
 cdef class Perturbs:
     """
@@ -947,16 +3107,14 @@ cdef class Perturbs:
     engine : ClassEngine
       the CLASS engine object
     """
-    cdef ClassEngine engine
-    cdef perturbs * pt
-    cdef background * ba
-
     def __init__(self, ClassEngine engine):
         self.engine = engine
-        self.engine.compute("perturbs")
         self.pt = &self.engine.pt
         self.ba = &self.engine.ba
 
+    def __reduce__(self):
+        return (Perturbs, (self.engine,))
+
     property k_max_for_pk:
         r"""
         The input parameter specifying the maximum ``k`` value to compute
@@ -985,30 +3143,317 @@ cdef class Perturbs:
             else:
               raise ValueError("gauge value not understood")
 
-cdef class Thermo:
-    """
-    A wrapper of the `thermo module <https://goo.gl/JKGUP6>`_ in CLASS.
+cdef class Thermo:
+    """
+    A wrapper of the `thermo module <https://goo.gl/JKGUP6>`_ in CLASS.
+
+    The methods returning a function of redshift accept an optional
+    ``out`` array, as numpy ufuncs do, and redshifts of any float type or
+    layout; they are evaluated without the GIL, in parallel.
+
+    Parameters
+    ----------
+    engine : ClassEngine
+      the CLASS engine object
+    nthreads : int, optional
+      the number of threads used to evaluate the thermodynamics quantities;
+      if not given, the value set by :func:`set_num_threads` is used
+
+    Attributes
+    ----------
+    nthreads : int
+      the number of threads used by :func:`compute_for_z`; 0 means the
+      default set by :func:`set_num_threads`
+    """
+    def __init__(self, ClassEngine engine, nthreads=None):
+        self.engine = engine
+        self.th = &self.engine.th
+        self.ba = &self.engine.ba
+        self.nthreads = 0 if nthreads is None else nthreads
+
+    def __reduce__(self):
+        return (Thermo, (self.engine, self.nthreads or None))
+
+    cdef int _compute_for_z(self, const double * z, Py_ssize_t zstride, Py_ssize_t size,
+                            const int * columns, int ncolumns,
+                            double * out, Py_ssize_t ostride, double scale,
+                            int monotonic, int nthreads) nogil:
+        r"""
+        Evaluate ``ncolumns`` columns of the thermodynamics vector at
+        ``size`` redshifts, stored every ``zstride`` values, without the
+        GIL; the layout of ``out`` is that of
+        :func:`Background._compute_for_z`.
+
+        Each redshift is interpolated only once for all the columns. If
+        ``monotonic`` is true, the spline interpolation starts from the
+        table index of the previous redshift of the thread
+        (``inter_closeby``). Returns ``_FAILURE_`` if any point failed,
+        leaving the reason in ``th.error_message``; as in
+        :func:`Background._compute_for_z`, the threads evaluate copies of
+        the structures.
+
+        Above the last redshift of the thermodynamics table, CLASS
+        extrapolates with the Hubble rate of ``pvecback``, so the
+        background vector is evaluated first for these redshifts.
+        """
+        cdef Py_ssize_t i
+        cdef int j
+        cdef int status
+        cdef double tau
+        cdef int last_index
+        cdef int last_index_bg
+        cdef int last_index_z
+        cdef int nfail = 0
+        cdef double z_max = self.th.z_table[self.th.tt_size-1]
+        cdef double * pvecback
+        cdef double * pvecthermo
+        cdef background * pba
+        cdef thermo * pth
+        cdef char * slot
+        cdef char * slots = <char*> calloc(nthreads, sizeof(ErrorMsg))
+
+        with parallel(num_threads=nthreads):
+            pvecback = <double*> malloc(sizeof(double) * self.ba.bg_size)
+            pvecthermo = <double*> malloc(sizeof(double) * self.th.th_size)
+            pba = <background*> malloc(sizeof(background))
+            pth = <thermo*> malloc(sizeof(thermo))
+            if pba != NULL:
+                memcpy(pba, self.ba, sizeof(background))
+            if pth != NULL:
+                memcpy(pth, self.th, sizeof(thermo))
+            slot = NULL
+            if slots != NULL:
+                slot = &slots[threadid() * sizeof(ErrorMsg)]
+
+            # carried over between the redshifts of one thread
+            last_index_z = 0
+
+            for i in prange(size, schedule='static'):
+                # assigned here so that they are private to each thread
+                tau = 0.
+                last_index = 0
+                last_index_bg = 0
+                status = _FAILURE_
+
+                if pvecback != NULL and pvecthermo != NULL and pba != NULL and pth != NULL:
+                    status = _SUCCESS_
+                    if z[i*zstride] >= z_max:
+                        status = background_tau_of_z(pba, z[i*zstride], &tau)
+                        if status == _SUCCESS_:
+                            status = background_at_tau(pba, tau, pba.long_info, pba.inter_normal,
+                                                       &last_index_bg, pvecback)
+                        if status == _FAILURE_:
+                            _record_failure(slot, pba.error_message)
+
+                    if status == _SUCCESS_:
+                        if monotonic:
+                            status = thermodynamics_at_z(pba, pth, z[i*zstride], pth.inter_closeby,
+                                                         &last_index_z, pvecback, pvecthermo)
+                        else:
+                            status = thermodynamics_at_z(pba, pth, z[i*zstride], pth.inter_normal,
+                                                         &last_index, pvecback, pvecthermo)
+                        if status == _FAILURE_:
+                            _record_failure(slot, pth.error_message)
+
+                if status == _FAILURE_:
+                    nfail += 1
+                else:
+                    for j in range(ncolumns):
+                        out[i * ostride + j] = pvecthermo[columns[j]] * scale
+
+            free(pvecback)
+            free(pvecthermo)
+            free(pba)
+            free(pth)
+
+        if nfail > 0:
+            _first_failure(slots, nthreads, self.th.error_message)
+        free(slots)
+        if nfail > 0:
+            return _FAILURE_
+        return _SUCCESS_
+
+    def compute_for_z(self, z, column, monotonic=None, out=None, double scale=1.):
+        """
+        Compute columns of the thermodynamics vector at redshifts ``z``, as
+        :func:`Background.compute_for_z`.
+
+        ``column`` is either a single CLASS index, or a list of indices, in
+        which case the columns are stacked along a new last axis. If
+        ``monotonic`` is True, ``z`` is assumed to be sorted (in either
+        order); by default, this is used if ``z`` is found to be sorted.
+        The results are multiplied by ``scale`` and written to ``out`` if
+        given; for a list of columns, ``out`` must be a C-contiguous float32
+        or float64 array.
+        """
+        self.engine.compute("thermodynamics")
+
+        cdef int status = _SUCCESS_
+        cdef int nthreads = self.nthreads if self.nthreads > 0 else _num_threads
+        cdef int sorted_z
+        cdef np.ndarray zc, oc
+        cdef double * pz
+        cdef double * pout
+        cdef Py_ssize_t size, zstride, ostride, ncol
+        cdef int single = np.ndim(column) == 0
+        cdef np.ndarray work = None
+
+        columns = np.array(column, dtype=np.intc, ndmin=1).reshape(-1)
+        if ((columns < 0) | (columns >= self.th.th_size)).any():
+            raise ValueError("thermodynamics column index out of range [0, %d)" % self.th.th_size)
+
+        cdef const int [::1] cols = columns
+        ncol = cols.shape[0]
+
+        if single:
+            it = _chunks([z, out])
+        else:
+            # the columns of one redshift are written next to each other;
+            # a float32 output is written from a float64 chunk
+            z = np.asarray(z)
+            out = _columns_out(z, ncol, out)
+            rows = out.reshape(-1, ncol)
+            it = _chunks([z], nout=0)
+
+        with it:
+            for chunk in it:
+                if single:
+                    zc, oc = chunk
+                    pout = _chunk_data(oc)
+                    ostride = _chunk_stride(oc)
+                else:
+                    zc = chunk
+                    if out.dtype == np.float64:
+                        pout = <double*> np.PyArray_DATA(out) + it.iterindex * ncol
+                    else:
+                        if work is None or work.shape[0] < zc.shape[0]:
+                            work = np.empty((zc.shape[0], ncol), np.float64)
+                        pout = <double*> np.PyArray_DATA(work)
+                    ostride = ncol
+
+                pz = _chunk_data(zc)
+                zstride = _chunk_stride(zc)
+                size = zc.shape[0]
+
+                if monotonic is None:
+                    with nogil:
+                        sorted_z = _is_monotonic(pz, zstride, size)
+                else:
+                    sorted_z = bool(monotonic)
+
+                with nogil:
+                    status = self._compute_for_z(pz, zstride, size, &cols[0], ncol,
+                                                 pout, ostride, scale, sorted_z, nthreads)
+
+                if status == _FAILURE_:
+                    raise ClassRuntimeError(self.th.error_message.decode())
+
+                if not single and out.dtype != np.float64:
+                    rows[it.iterindex:it.iterindex + size] = work[:size]
+
+            if single:
+                out = it.operands[1]
+
+        return out
+
+    property columns:
+        r"""
+        A dictionary mapping the names of the available columns of the
+        thermodynamics vector to their CLASS index. The columns are in
+        CLASS units, i.e., powers of :math:`\mathrm{Mpc}`, and the
+        derivatives are with respect to conformal time.
+
+        These are the names accepted by :func:`evaluate`.
+        """
+        def __get__(self):
+            self.engine.compute("thermodynamics")
+            columns = {}
+            columns['x_e'] = self.th.index_th_xe
+            columns['kappa_prime'] = self.th.index_th_dkappa
+            columns['kappa_prime_prime'] = self.th.index_th_ddkappa
+            columns['exp_m_kappa'] = self.th.index_th_exp_m_kappa
+            columns['g'] = self.th.index_th_g
+            columns['g_prime'] = self.th.index_th_dg
+            columns['tau_d'] = self.th.index_th_tau_d
+            columns['Tb'] = self.th.index_th_Tb
+            columns['cb2'] = self.th.index_th_cb2
+            columns['rate'] = self.th.index_th_rate
+            return columns
+
+    def evaluate(self, z, columns=None):
+        r"""
+        Compute several columns of the thermodynamics vector at once, with
+        a single interpolation of the thermodynamics tables per redshift.
+
+        Parameters
+        ----------
+        z : float, array_like
+          the redshift values
+        columns : list of str, optional
+          the names of the columns to compute, as listed in :attr:`columns`;
+          by default all columns are returned
+
+        Returns
+        -------
+        array_like :
+          structured array of the same shape as ``z``, with one field per
+          column, in CLASS units
+        """
+        available = self.columns
+        if columns is None:
+            columns = list(available)
+        elif isinstance(columns, str):
+            columns = [columns]
+
+        for name in columns:
+            if name not in available:
+                raise ValueError("unknown thermodynamics column '%s'; valid names are %s"
+                                 % (name, ', '.join(available)))
+
+        data = self.compute_for_z(z, [available[name] for name in columns])
+        dtype = np.dtype([(str(name), data.dtype) for name in columns])
+        return data.view(dtype).reshape(data.shape[:-1])
+
+    def x_e(self, z, out=None):
+        r"""
+        The free electron fraction :math:`x_e` at redshift ``z``.
+        """
+        self.engine.compute("thermodynamics")
+        return self.compute_for_z(z, self.th.index_th_xe, out=out)
 
-    Parameters
-    ----------
-    engine : ClassEngine
-      the CLASS engine object
-    """
-    cdef ClassEngine engine
-    cdef thermo * th
-    cdef background * ba
+    def T_b(self, z, out=None):
+        r"""
+        The baryon temperature at redshift ``z``, in K.
+        """
+        self.engine.compute("thermodynamics")
+        return self.compute_for_z(z, self.th.index_th_Tb, out=out)
 
-    def __init__(self, ClassEngine engine):
-        self.engine = engine
+    def visibility(self, z, out=None):
+        r"""
+        The visibility function :math:`g = \kappa' e^{-\kappa}` at
+        redshift ``z``, the probability density of last scattering per
+        unit conformal time, in :math:`h \mathrm{Mpc}^{-1}`.
+        """
         self.engine.compute("thermodynamics")
-        self.th = &self.engine.th
-        self.ba = &self.engine.ba
+        return self.compute_for_z(z, self.th.index_th_g, out=out, scale=1. / self.ba.h)
+
+    def sound_horizon(self, z, out=None):
+        r"""
+        The comoving sound horizon of the photon-baryon fluid at redshift
+        ``z``, in :math:`\mathrm{Mpc}/h`.
+        """
+        # the background wrapper follows the engine, so it is made once
+        if self._background is None:
+            self._background = Background(self.engine)
+        self._background.nthreads = self.nthreads
+        return self._background.compute_for_z(z, self.ba.index_bg_rs, out=out, scale=self.ba.h)
 
     property z_drag:
         r"""
         The baryon drag redshift.
         """
         def __get__(self):
+            self.engine.compute("thermodynamics")
             return self.th.z_d
 
     property rs_drag:
@@ -1016,6 +3461,7 @@ cdef class Thermo:
         The comoving sound horizon at baryon drag, in :math:`\mathrm{Mpc}/h`.
         """
         def __get__(self):
+            self.engine.compute("thermodynamics")
             return self.th.rs_d * self.ba.h
 
     property tau_reio:
@@ -1023,6 +3469,7 @@ cdef class Thermo:
         The reionization optical depth.
         """
         def __get__(self):
+            self.engine.compute("thermodynamics")
             return self.th.tau_reio
 
     property z_reio:
@@ -1030,6 +3477,7 @@ cdef class Thermo:
         The reionization redshift.
         """
         def __get__(self):
+            self.engine.compute("thermodynamics")
             return self.th.z_reio
 
     property z_rec:
@@ -1038,6 +3486,7 @@ cdef class Thermo:
         the recombination redshift.
         """
         def __get__(self):
+            self.engine.compute("thermodynamics")
             return self.th.z_rec
 
     property rs_rec:
@@ -1046,6 +3495,7 @@ cdef class Thermo:
         Units of :math:`\mathrm{Mpc}/h`.
         """
         def __get__(self):
+            self.engine.compute("thermodynamics")
             return self.th.rs_rec * self.ba.h
 
     property theta_s:
@@ -1054,8 +3504,29 @@ cdef class Thermo:
         :math:`r_s(z_\mathrm{rec}) / D_a(z_\mathrm{rec})`.
         """
         def __get__(self):
+            self.engine.compute("thermodynamics")
             return self.th.rs_rec / self.th.ra_rec
 
+    property thermodynamics_table:
+        r"""
+        The thermodynamics table of CLASS, of shape ``(tt_size, th_size)``,
+        as a read-only view of the memory of the engine. The rows
+        correspond to :attr:`z_table`.
+        """
+        def __get__(self):
+            self.engine.compute("thermodynamics")
+            return _table_view(self.th.thermodynamics_table, (self.th.tt_size, self.th.th_size), self.engine,
+                               "thermodynamics")
+
+    property z_table:
+        r"""
+        The redshift of the rows of :attr:`thermodynamics_table`, as a
+        read-only view.
+        """
+        def __get__(self):
+            self.engine.compute("thermodynamics")
+            return _table_view(self.th.z_table, (self.th.tt_size,), self.engine, "thermodynamics")
+
 
 cdef class Primordial:
     """
@@ -1066,19 +3537,53 @@ cdef class Primordial:
     engine : ClassEngine
       the CLASS engine object
     """
-    cdef ClassEngine engine
-    cdef perturbs * pt
-    cdef primordial * pm
-    cdef background * ba
-
     def __init__(self, ClassEngine engine):
         self.engine = engine
-        self.engine.compute("primordial")
         self.pt = &self.engine.pt
         self.ba = &self.engine.ba
         self.pm = &self.engine.pm
 
-    def get_pkprim(self, k):
+    def __reduce__(self):
+        return (Primordial, (self.engine,))
+
+    cdef int _pkprim_many(self, const double * k, Py_ssize_t kstride,
+                          const double * tk, Py_ssize_t tstride, Py_ssize_t size,
+                          double * out, Py_ssize_t ostride) nogil:
+        r"""
+        Evaluate the primordial power spectrum at ``size`` values of ``k``
+        in :math:`h \mathrm{Mpc}^{-1}`, stored every ``kstride`` values,
+        without the GIL; see :func:`_primordial_at_k`.
+
+        If ``tk`` is not NULL, the results are multiplied by
+        :math:`2\pi^2 T^2(k) / k^3`. Returns ``_FAILURE_`` at the first
+        failure, leaving the reason in ``pm.error_message``.
+        """
+        cdef Py_ssize_t i
+        cdef int status = _SUCCESS_
+        cdef double h = self.ba.h
+        cdef double kk, t
+        cdef double * work
+
+        work = <double*> malloc(sizeof(double) * self.pm.ic_ic_size[0])
+        if work == NULL:
+            strncpy(self.pm.error_message, "could not allocate primordial workspace", sizeof(ErrorMsg))
+            return _FAILURE_
+
+        for i in range(size):
+            kk = k[i*kstride]
+            # convert to 1/Mpc
+            status = _primordial_at_k(self.pm, kk * h, &out[i*ostride], work)
+            if status == _FAILURE_:
+                break
+            if tk != NULL and kk != 0:
+                # the k^3 of the h/Mpc units cancels the h^3 of (Mpc/h)^3
+                t = tk[i*tstride]
+                out[i*ostride] *= 2 * M_PI * M_PI * t * t / (kk * kk * kk)
+
+        free(work)
+        return status
+
+    def get_pkprim(self, k, out=None, tk=None):
         r"""
         The primoridal spectrum of curvation perturabtion at ``k``, generated by 
         inflation. This is defined as:
@@ -1089,42 +3594,73 @@ cdef class Primordial:
 
         See also: equation 2 of `this reference <https://arxiv.org/abs/1303.5076>`_.
 
+        For the analytic spectrum, the closed form is evaluated directly
+        rather than the spline of the tabulated spectrum.
+
         Parameters
         ----------
         k : array_like
           wavenumbers in :math:`h \mathrm{Mpc}^{-1}` units.
+        out : array_like, optional
+          an array of the shape of ``k`` to store the results in
+        tk : array_like, optional
+          a transfer function in the CLASS format, i.e., normalized to a
+          unit curvature perturbation, broadcast with ``k``. If given, the
+          power spectrum of the transfer function,
+          :math:`2\pi^2 T^2(k) \mathcal{P_R}(k) / k^3` in
+          :math:`(\mathrm{Mpc}/h)^3`, is returned in the same pass.
 
         Returns
         -------
         array_like :
-          the primordial power
+          the primordial power, or the power spectrum of ``tk``
         """
-        #generate a new output array of the correct shape by broadcasting input arrays together
-        k = np.float64(k) * self.ba.h # convert to 1/Mpc
-        out = np.empty(np.broadcast(k).shape, np.float64)
-
-        #generate the iterator over the input and output arrays, does the same thing as
-        cdef np.broadcast it = np.broadcast(k,  out)
-        cdef int index_md = 0
+        self.engine.compute("primordial")
 
-        while np.PyArray_MultiIter_NOTDONE(it):
+        cdef int status = _SUCCESS_
+        cdef np.ndarray kc, tc, oc
+        cdef const double * ptk = NULL
+        cdef Py_ssize_t tstride = 0
 
-                #PyArray_MultiIter_DATA is used to access the pointers the iterator points to
-                aval = (<double*>np.PyArray_MultiIter_DATA(it, 0))[0]
+        if tk is None:
+            it = _chunks([k, out])
+        else:
+            it = _chunks([k, tk, out])
 
-                if aval == 0: # forcefully set k == 0 to zero.
-                    (<double*>(np.PyArray_MultiIter_DATA(it, 1)))[0] = 0.
+        with it:
+            for chunk in it:
+                if tk is None:
+                    kc, oc = chunk
                 else:
-                    if _FAILURE_ == primordial_spectrum_at_k(self.pm, index_md, linear, aval,
-                        <double*>(np.PyArray_MultiIter_DATA(it, 1))):
-                        raise ClassRuntimeError(self.pm.error_message.decode())
+                    kc, tc, oc = chunk
+                    ptk = _chunk_data(tc)
+                    tstride = _chunk_stride(tc)
 
-                #PyArray_MultiIter_NEXT is used to advance the iterator
-                np.PyArray_MultiIter_NEXT(it)
+                with nogil:
+                    status = self._pkprim_many(_chunk_data(kc), _chunk_stride(kc), ptk, tstride,
+                                               kc.shape[0], _chunk_data(oc), _chunk_stride(oc))
+
+                if status == _FAILURE_:
+                    raise ClassRuntimeError(self.pm.error_message.decode())
+            out = it.operands[-1]
 
         # Watch out: no transformation here
         return out
 
+    def as_ufunc(self):
+        r"""
+        Return a numpy ufunc evaluating :func:`get_pkprim`, with float64
+        and float32 loops. Failed evaluations give NaN.
+
+        Returns
+        -------
+        numpy.ufunc :
+          the ufunc ``f(k)``, with ``k`` in :math:`h \mathrm{Mpc}^{-1}`
+        """
+        cdef _UFuncKernel kern = _UFuncKernel(self.engine, "primordial")
+        return _make_ufunc(kern, _ufunc_pkprim_loops, 1, "pkprim",
+                           "the primordial power spectrum as a function of k")
+
     def get_primordial(self):
         r"""
         Return the primordial scalar and/or tensor spectrum depending on 'modes'.
@@ -1136,6 +3672,8 @@ cdef class Primordial:
         array_like :
           structured array containing k-vector and primordial scalar and tensor :math:`P(k)`.
         """
+        self.engine.compute("primordial")
+
         primordial = {}
         cdef char titles[_MAXTITLESTRINGLENGTH_]
         memset(titles, 0, _MAXTITLESTRINGLENGTH_)
@@ -1161,24 +3699,17 @@ cdef class Spectra:
     engine : ClassEngine
       the CLASS engine object
     """
-    cdef ClassEngine engine
-    cdef spectra * sp
-    cdef background * ba
-    cdef perturbs * pt
-    cdef primordial * pm
-    cdef nonlinear * nl
-    cdef readonly dict data
-
     def __init__(self, ClassEngine engine):
         self.engine = engine
-        self.engine.compute("spectra")
-
         self.ba = &self.engine.ba
         self.nl = &self.engine.nl
         self.sp = &self.engine.sp
         self.pt = &self.engine.pt
         self.pm = &self.engine.pm
 
+    def __reduce__(self):
+        return (Spectra, (self.engine,))
+
     property nonlinear:
         r"""
         Boolean flag specifying whether the power spectrum is nonlinear.
@@ -1194,6 +3725,15 @@ cdef class Spectra:
         def __get__(self):
           return self.pt.has_pk_matter
 
+    property has_transfers:
+        r"""
+        Boolean flag specifying whether the density or velocity transfer
+        functions have been requested as output, as needed by
+        :func:`get_transfer`.
+        """
+        def __get__(self):
+          return bool(self.pt.has_density_transfers or self.pt.has_velocity_transfers)
+
     property P_k_min:
         r"""
         The minimum ``k`` value for which power spectra have been computed in
@@ -1202,6 +3742,7 @@ cdef class Spectra:
         This is computed from the ``ln_k`` array of the Spectra module.
         """
         def __get__(self):
+            self.engine.compute("spectra")
             # factor of 1.001 to avoid bounds errors due to rounding errors
             return 1.001*np.exp(self.sp.ln_k[0])/self.ba.h;
 
@@ -1211,6 +3752,7 @@ cdef class Spectra:
         :math:`h \mathrm{Mpc}^{-1}`.
         """
         def __get__(self):
+            self.engine.compute("spectra")
             # factor of 0.999 to avoid bounds errors due to rounding errors
             return 0.999*np.exp(self.sp.ln_k[self.sp.ln_k_size-1])/self.ba.h;
 
@@ -1219,6 +3761,7 @@ cdef class Spectra:
         The amplitude of matter fluctuations at :math:`z=0`.
         """
         def __get__(self):
+            self.engine.compute("spectra")
             return self.sp.sigma8
 
     property A_s:
@@ -1251,32 +3794,298 @@ cdef class Spectra:
         def __get__(self):
             return self.pm.k_pivot / self.ba.h
 
-    def sigma8_z(self, z):
+    property ln_k:
         r"""
-        Return :math:`\sigma_8(z)`.
+        The :math:`\ln k` table of CLASS, with :math:`k` in
+        :math:`\mathrm{Mpc}^{-1}`, as a read-only view of the memory of
+        the engine.
         """
-        #generate a new output array of the correct shape by broadcasting input arrays together
-        z = np.float64(z)
-        out = np.empty(np.broadcast(z).shape, np.float64)
+        def __get__(self):
+            self.engine.compute("spectra")
+            return _table_view(self.sp.ln_k, (self.sp.ln_k_size,), self.engine, "spectra")
 
-        #generate the iterator over the input and output arrays, does the same thing as
-        cdef np.broadcast it = np.broadcast(z,  out)
+    property ln_tau:
+        r"""
+        The :math:`\ln \tau` table of CLASS on which the power spectrum is
+        stored, with :math:`\tau` in :math:`\mathrm{Mpc}`, as a read-only
+        view of the memory of the engine.
+        """
+        def __get__(self):
+            self.engine.compute("spectra")
+            return _table_view(self.sp.ln_tau, (self.sp.ln_tau_size,), self.engine, "spectra")
 
-        while np.PyArray_MultiIter_NOTDONE(it):
+    property ln_pk:
+        r"""
+        The linear power spectrum table of CLASS, of shape
+        ``(ln_tau_size, ln_k_size, ic_ic_size)``, as a read-only view of the
+        memory of the engine.
+
+        For a single initial condition, this is :math:`\ln P` with
+        :math:`P` in :math:`\mathrm{Mpc}^3`; see the CLASS documentation
+        of ``ln_pk`` for the cross-correlation of several initial
+        conditions.
+        """
+        def __get__(self):
+            self.engine.compute("spectra")
+            return _table_view(self.sp.ln_pk,
+                               (self.sp.ln_tau_size, self.sp.ln_k_size,
+                                self.sp.ic_ic_size[self.sp.index_md_scalars]),
+                               self.engine, "spectra")
 
-                #PyArray_MultiIter_DATA is used to access the pointers the iterator points to
-                aval = (<double*>np.PyArray_MultiIter_DATA(it, 0))[0]
+    property ln_pk_nl:
+        r"""
+        The nonlinear power spectrum table of CLASS, :math:`\ln P` of shape
+        ``(ln_tau_size, ln_k_size)``, as a read-only view of the memory of
+        the engine. Only available if nonlinear is enabled.
+        """
+        def __get__(self):
+            self.engine.compute("spectra")
+            if self.nl.method == 0:
+                raise ClassRuntimeError("nonlinear power spectrum is not computed")
+            return _table_view(self.sp.ln_pk_nl, (self.sp.ln_tau_size, self.sp.ln_k_size), self.engine,
+                               "spectra")
 
-                if _FAILURE_ == spectra_sigma(self.ba, self.pm, self.sp, 8./self.ba.h, aval,
-                    <double*>(np.PyArray_MultiIter_DATA(it, 1))):
-                    raise ClassRuntimeError(self.sp.error_message.decode())
+    def sigma8_z(self, z, nthreads=None, out=None):
+        r"""
+        Return :math:`\sigma_8(z)`.
 
-                #PyArray_MultiIter_NEXT is used to advance the iterator
-                np.PyArray_MultiIter_NEXT(it)
+        The redshifts are evaluated without the GIL, split over
+        ``nthreads`` threads; if not given, the value set by
+        :func:`set_num_threads` is used. The results are written to
+        ``out`` if given.
+        """
+        cdef int nth = _thread_count(nthreads)
+        cdef int status
+        cdef np.ndarray zc, oc
+
+        self.engine.compute("spectra")
+
+        it = _chunks([z, out])
+        with it:
+            for zc, oc in it:
+                with nogil:
+                    status = self._sigma8_many(_chunk_data(zc), _chunk_stride(zc), zc.shape[0],
+                                               _chunk_data(oc), _chunk_stride(oc), nth)
+
+                if status == _FAILURE_:
+                    raise ClassRuntimeError(self.sp.error_message.decode())
+            out = it.operands[1]
 
         return out
 
-    def get_transfer(self, z, output_format='class'):
+    cdef int _sigma8_many(self, const double * z, Py_ssize_t zstride, Py_ssize_t size,
+                          double * out, Py_ssize_t ostride, int nthreads) nogil:
+        r"""
+        Compute :math:`\sigma_8` at ``size`` redshifts over ``nthreads``
+        threads, without the GIL. Returns ``_FAILURE_`` if any redshift
+        failed, leaving the reason in ``sp.error_message``; as in
+        :func:`Background._compute_for_z`, the threads evaluate copies of
+        the structure and the first failure of the first failing thread is
+        copied back.
+        """
+        cdef Py_ssize_t i
+        cdef int nfail = 0
+        cdef double R = 8. / self.ba.h
+        cdef spectra * psp
+        cdef char * slot
+        cdef char * slots = <char*> calloc(nthreads, sizeof(ErrorMsg))
+
+        with parallel(num_threads=nthreads):
+            psp = <spectra*> malloc(sizeof(spectra))
+            if psp != NULL:
+                memcpy(psp, self.sp, sizeof(spectra))
+            slot = NULL
+            if slots != NULL:
+                slot = &slots[threadid() * sizeof(ErrorMsg)]
+
+            for i in prange(size, schedule='dynamic'):
+                if psp == NULL:
+                    nfail += 1
+                elif spectra_sigma(self.ba, self.pm, psp, R, z[i*zstride], &out[i*ostride]) == _FAILURE_:
+                    nfail += 1
+                    _record_failure(slot, psp.error_message)
+
+            free(psp)
+
+        if nfail > 0:
+            _first_failure(slots, nthreads, self.sp.error_message)
+        free(slots)
+        if nfail > 0:
+            return _FAILURE_
+        return _SUCCESS_
+
+    cdef Py_ssize_t _sigma_many(self, PowerSpectrumInterpolator pk,
+                                const double * k, Py_ssize_t nk,
+                                const double * W2, const double * dW2, Py_ssize_t nR,
+                                const double * z, Py_ssize_t nz,
+                                double * s2, double * ds2, int nthreads) nogil:
+        r"""
+        Integrate the variance of the power spectrum ``pk``, and its
+        derivative with respect to :math:`\ln R` if ``dW2`` is not NULL,
+        for ``nR`` radii and ``nz`` redshifts, without the GIL.
+
+        ``W2`` and ``dW2`` are the ``(nR, nk)`` matrices of the squared
+        window and of its derivative at the quadrature nodes ``k``, which
+        already include the quadrature weights. The power spectrum is
+        sampled once per redshift and shared by all the radii; the
+        redshifts are split over ``nthreads`` threads.
+
+        Returns the number of redshifts out of the range of ``pk``.
+        """
+        cdef Py_ssize_t i, j, r
+        cdef Py_ssize_t nbad = 0
+        cdef double acc, dacc
+        cdef double * p
+
+        with parallel(num_threads=nthreads):
+            p = <double*> malloc(sizeof(double) * nk)
+
+            for j in prange(nz, schedule='dynamic'):
+                if p == NULL:
+                    nbad += 1
+                else:
+                    for i in range(nk):
+                        p[i] = k[i] * k[i] * k[i] * pk.evaluate(k[i], z[j])
+
+                    # out of range redshifts give NaN
+                    if p[0] != p[0]:
+                        nbad += 1
+
+                    # acc = acc + ... keeps the sums private to each thread
+                    for r in range(nR):
+                        acc = 0.
+                        for i in range(nk):
+                            acc = acc + W2[r * nk + i] * p[i]
+                        s2[r * nz + j] = acc
+
+                        if dW2 != NULL:
+                            dacc = 0.
+                            for i in range(nk):
+                                dacc = dacc + dW2[r * nk + i] * p[i]
+                            ds2[r * nz + j] = dacc
+
+            free(p)
+
+        return nbad
+
+    def sigma(self, R, z, derivative=False, Py_ssize_t size=1025, nthreads=None):
+        r"""
+        The rms :math:`\sigma(R, z)` of the linear density field smoothed
+        by a spherical top-hat of radius ``R``, and optionally
+        :math:`d\ln\sigma / d\ln R`.
+
+        The integrals use Simpson's rule on ``size`` nodes uniform in
+        :math:`\ln k` over the range of the power spectrum tables. For
+        each redshift the power spectrum is sampled once on these nodes
+        and reused for all radii; the redshifts are computed without the
+        GIL, in parallel.
+
+        Parameters
+        ----------
+        R : array_like
+          the radii, in :math:`\mathrm{Mpc}/h`
+        z : array_like
+          the redshifts
+        derivative : bool, optional
+          also return :math:`d\ln\sigma / d\ln R`
+        size : int, optional
+          the number of quadrature nodes; must be odd
+        nthreads : int, optional
+          the number of threads; if not given, the value set by
+          :func:`set_num_threads` is used
+
+        Returns
+        -------
+        sigma : array_like
+          of shape ``R.shape + z.shape``
+        dlnsigma_dlnR : array_like
+          of the same shape, if ``derivative`` is True
+        """
+        cdef int nth = _thread_count(nthreads)
+        cdef Py_ssize_t nbad
+        cdef PowerSpectrumInterpolator pk
+
+        # the spline of the tables is reused until the spectra are freed
+        self.engine.compute("spectra")
+        pk = self.engine._derived.get(("spectra", "sigma"))
+        if pk is None:
+            pk = PowerSpectrumInterpolator(self, linear=True)
+            self.engine._derived[("spectra", "sigma")] = pk
+
+        if size < 3 or size % 2 == 0:
+            raise ValueError("the number of quadrature nodes must be odd and at least 3")
+
+        R = np.asarray(R, dtype=np.float64)
+        z = np.asarray(z, dtype=np.float64)
+        if (R <= 0).any():
+            raise ValueError("the radii must be positive")
+
+        # Simpson weights on a uniform grid in ln k, with the 1 / (2 pi^2)
+        lnk = np.linspace(pk.ln_k[0], pk.ln_k[-1], size)
+        w = np.ones(size)
+        w[1:-1:2] = 4.
+        w[2:-1:2] = 2.
+        w *= (lnk[1] - lnk[0]) / 3. / (2 * np.pi ** 2)
+
+        k = np.exp(lnk)
+        x = R.reshape(-1, 1) * k
+
+        # top-hat window and its derivative, with a series at small kR
+        with np.errstate(divide='ignore', invalid='ignore'):
+            W = np.where(x < 1e-3, 1. - x ** 2 / 10.,
+                         3 * (np.sin(x) - x * np.cos(x)) / x ** 3)
+            dW = np.where(x < 1e-3, - x / 5.,
+                          3 * ((x ** 2 - 3.) * np.sin(x) + 3 * x * np.cos(x)) / x ** 4)
+
+        cdef const double [::1] kk = k
+        cdef const double [:, ::1] W2 = np.ascontiguousarray(W ** 2 * w)
+        cdef const double [:, ::1] dW2 = np.ascontiguousarray(2 * W * dW * x * w)
+        cdef const double [::1] zz = np.ascontiguousarray(z).reshape(-1)
+
+        s2 = np.empty((W2.shape[0], zz.shape[0]), np.float64)
+        ds2 = np.empty((W2.shape[0], zz.shape[0]), np.float64)
+        cdef double [:, ::1] ss2 = s2
+        cdef double [:, ::1] dss2 = ds2
+
+        shape = R.shape + z.shape
+        if s2.size == 0:
+            return (s2.reshape(shape), ds2.reshape(shape)) if derivative else s2.reshape(shape)
+
+        cdef const double * pdW2 = &dW2[0, 0] if derivative else NULL
+
+        with nogil:
+            nbad = self._sigma_many(pk, &kk[0], size, &W2[0, 0], pdW2, W2.shape[0],
+                                    &zz[0], zz.shape[0], &ss2[0, 0], &dss2[0, 0], nth)
+
+        if nbad > 0:
+            raise ValueError("%d redshift(s) out of the range of the power spectrum [%g, %g]"
+                             % (nbad, pk.z_min, pk.z_max))
+
+        sigma = np.sqrt(s2)
+        if not derivative:
+            return sigma.reshape(shape)
+        return sigma.reshape(shape), (0.5 * ds2 / s2).reshape(shape)
+
+    cdef np.dtype _transfer_dtype(self, file_format outf):
+        r"""
+        The dtype of the transfer functions in format ``outf``, parsed from
+        the CLASS titles once per format and set of outputs.
+        """
+        cdef char titles[_MAXTITLESTRINGLENGTH_]
+
+        key = (outf, val2str(self.engine.pars.get('output', '')))
+        if self._transfer_dtypes is None:
+            self._transfer_dtypes = {}
+        if key not in self._transfer_dtypes:
+            memset(titles, 0, _MAXTITLESTRINGLENGTH_)
+            if spectra_output_tk_titles(self.ba, self.pt, outf, titles)==_FAILURE_:
+                raise ClassRuntimeError(self.sp.error_message.decode())
+
+            # k is in h/Mpc. Other functions unit is unclear.
+            self._transfer_dtypes[key] = _titles_to_dtype(titles, remove_units=True)
+        return self._transfer_dtypes[key]
+
+    def get_transfer(self, z, output_format='class', nthreads=None):
         r"""
         Return the density and/or velocity transfer functions for all initial
         conditions today. You must include 'dCl' and 'vCl' in the list of
@@ -1284,69 +4093,352 @@ cdef class Spectra:
         redshift ``z`` provided that 'z_pk' has been set and that ``z`` is
         inside the region spanned by 'z_pk'.
 
-        This function is not vectorized because it returns a vector when
-        'ic_size' is greater than 1, and we don't understand 'ic_size'.
+        For a scalar ``z``, a dict keyed by initial condition is returned
+        when 'ic_size' is greater than 1. For an array of redshifts, all
+        the transfer functions are returned in one array and the
+        redshifts are evaluated without the GIL, in parallel.
 
         Parameters
         ----------
-        z  : float
+        z  : float, array_like
           redshift (default = 0)
         output_format  : ('class' or 'camb')
           Format transfer functions according to CLASS convention (default)
           or CAMB convention.
+        nthreads : int, optional
+          the number of threads for an array of redshifts; if not given,
+          the value set by :func:`set_num_threads` is used
 
         Returns
         -------
         tk : array_like
           array containing transfer functions. ``k`` here is in units of
-          :math:`h \mathrm{Mpc}^{-1}`.
+          :math:`h \mathrm{Mpc}^{-1}`. For an array of redshifts, the
+          shape is ``z.shape + (ic_size, ln_k_size)``.
         """
         if (not self.pt.has_density_transfers) and (not self.pt.has_velocity_transfers):
             raise RuntimeError("Perturbation is not computed")
+        self.engine.compute("spectra")
 
         cdef FileName ic_suffix
-        cdef file_format_outf
+        cdef file_format outf
         cdef char ic_info[1024]
-
-        cdef char titles[_MAXTITLESTRINGLENGTH_]
-        memset(titles, 0, _MAXTITLESTRINGLENGTH_)
+        cdef int nth = _thread_count(nthreads)
+        cdef Py_ssize_t stride
+        cdef int ntitles
+        cdef int status
 
         if output_format == 'camb':
             outf = camb_format
         else:
             outf = class_format
 
-        if spectra_output_tk_titles(self.ba, self.pt, outf, titles)==_FAILURE_:
-            raise ClassRuntimeError(self.op.error_message.decode())
-
-        # k is in h/Mpc. Other functions unit is unclear.
-        dtype = _titles_to_dtype(titles, remove_units=True)
+        dtype = self._transfer_dtype(outf)
+        ntitles = len(dtype.fields)
 
         index_md = 0
         ic_num = self.sp.ic_size[index_md]
 
-        cdef np.ndarray data = np.zeros((ic_num, self.sp.ln_k_size), dtype=dtype)
+        scalar = np.ndim(z) == 0
+        z = np.asarray(z, dtype=np.float64)
+        cdef const double [::1] zz = np.ascontiguousarray(z).reshape(-1)
+
+        cdef np.ndarray data = np.zeros((zz.shape[0], ic_num, self.sp.ln_k_size), dtype=dtype)
+        cdef double * pdata = <double*> data.data
+        stride = ic_num * self.sp.ln_k_size * ntitles
 
-        if spectra_output_tk_data(self.ba, self.pt, self.sp, outf, <double> z, len(dtype.fields), <double*> data.data)==_FAILURE_:
+        with nogil:
+            status = self._transfer_many(outf, &zz[0], zz.shape[0], ntitles, pdata, stride, nth)
+
+        if status == _FAILURE_:
             raise ClassRuntimeError(self.sp.error_message.decode())
 
+        if not scalar:
+            return data.reshape(z.shape + (ic_num, self.sp.ln_k_size))
+
         ic_keys = []
         if ic_num > 1:
             for index_ic in range(ic_num):
                 if spectra_firstline_and_ic_suffix(self.pt, index_ic, ic_info, ic_suffix)==_FAILURE_:
-                    raise ClassRuntimeError(self.op.error_message.decode())
+                    raise ClassRuntimeError(self.sp.error_message.decode())
 
                 ic_key = <bytes> ic_suffix
                 ic_keys.append(ic_key.decode())
 
             spectra = {}
-            for ic_key, row in zip(ic_keys, data):
+            for ic_key, row in zip(ic_keys, data[0]):
                 spectra[ic_key] = row
         else:
-            spectra = data[0]
+            spectra = data[0, 0]
 
         return spectra
 
+    cdef int _transfer_many(self, file_format outf, const double * z, Py_ssize_t size,
+                            int ntitles, double * data, Py_ssize_t stride, int nthreads) nogil:
+        r"""
+        Write the transfer functions in format ``outf`` at ``size``
+        redshifts, every ``stride`` values of ``data``, over ``nthreads``
+        threads and without the GIL. Returns ``_FAILURE_`` if any redshift
+        failed, leaving the first failure of the first failing thread in
+        ``sp.error_message``, as :func:`_sigma8_many`.
+        """
+        cdef Py_ssize_t i
+        cdef int nfail = 0
+        cdef spectra * psp
+        cdef char * slot
+        cdef char * slots = <char*> calloc(nthreads, sizeof(ErrorMsg))
+
+        with parallel(num_threads=nthreads):
+            psp = <spectra*> malloc(sizeof(spectra))
+            if psp != NULL:
+                memcpy(psp, self.sp, sizeof(spectra))
+            slot = NULL
+            if slots != NULL:
+                slot = &slots[threadid() * sizeof(ErrorMsg)]
+
+            for i in prange(size, schedule='dynamic'):
+                if psp == NULL:
+                    nfail += 1
+                elif spectra_output_tk_data(self.ba, self.pt, psp, outf, z[i], ntitles,
+                                            data + i * stride) == _FAILURE_:
+                    nfail += 1
+                    _record_failure(slot, psp.error_message)
+
+            free(psp)
+
+        if nfail > 0:
+            _first_failure(slots, nthreads, self.sp.error_message)
+        free(slots)
+        if nfail > 0:
+            return _FAILURE_
+        return _SUCCESS_
+
+    def paint(self, nmesh, double boxsize, double z=0., kind='pklin', out=None,
+              offset=None, multiply=False, double exponent=1., nthreads=None):
+        r"""
+        Fill a 3D Fourier grid with the power spectrum or a transfer
+        function of :math:`|k|`, in place, e.g. for the initial conditions
+        of N-body simulations.
+
+        The value on each cell only depends on the squared integer
+        frequency :math:`n^2 = n_x^2 + n_y^2 + n_z^2`, so the function is
+        evaluated once for each :math:`n^2` on the mesh, and the grid is
+        painted from that table in parallel over the planes of the first
+        axis, without temporaries of the size of the grid. The index
+        ``i`` of an axis of size ``N`` has the frequency ``i`` if
+        ``i <= N // 2`` and ``i - N`` otherwise, so ``out`` can be the
+        full transform or the half of a real transform along the last
+        axis. The mode at :math:`k = 0` is set to 0.
+
+        Parameters
+        ----------
+        nmesh : int or tuple of 3 ints
+          the number of cells of the mesh along each axis
+        boxsize : float
+          the side of the cubic box, in :math:`\mathrm{Mpc}/h`; the
+          fundamental frequency is :math:`2 \pi / L`
+        z : float, optional
+          the redshift
+        kind : str, optional
+          'pklin' or 'pk' for the linear or primary power spectrum, in
+          :math:`(\mathrm{Mpc}/h)^3`, or the name of a column of
+          :func:`get_transfer`, e.g. 'd_tot', interpolated with a cubic
+          spline in :math:`\ln k`; transfer functions are those of the
+          first initial condition.
+        out : array_like, optional
+          the grid to paint, a writeable 3D array of float32, float64,
+          complex64 or complex128 values with any strides; assigning a
+          complex grid sets the imaginary part to 0. By default, a float64
+          array of shape ``(N0, N1, N2 // 2 + 1)`` is returned.
+        offset : tuple of 3 ints, optional
+          the index on the mesh of ``out[0, 0, 0]``, e.g. for the slab of
+          one rank of a distributed FFT
+        multiply : bool, optional
+          if True, multiply ``out`` by the values instead of assigning
+          them, e.g. to apply the square root of the power spectrum to a
+          white noise field
+        exponent : float, optional
+          the power to which the values are raised, e.g. 0.5 for the
+          amplitude of the modes
+        nthreads : int, optional
+          the number of threads; if not given, the value set by
+          :func:`set_num_threads` is used
+
+        Returns
+        -------
+        out : array_like
+          the painted grid
+        """
+        cdef int nth = _thread_count(nthreads)
+        cdef Py_ssize_t _nmesh[3]
+        cdef Py_ssize_t _offset[3]
+        cdef Py_ssize_t _shape[3]
+        cdef Py_ssize_t _strides[3]
+        cdef int dtype, a
+        cdef np.ndarray grid
+
+        if np.ndim(nmesh) == 0:
+            nmesh = (nmesh,) * 3
+        if offset is None:
+            offset = (0, 0, 0)
+        if len(nmesh) != 3 or len(offset) != 3:
+            raise ValueError("nmesh and offset must have 3 values")
+        if boxsize <= 0:
+            raise ValueError("boxsize must be positive")
+
+        if out is None:
+            if multiply:
+                raise ValueError("multiply requires an out array")
+            out = np.empty((nmesh[0], nmesh[1], nmesh[2] // 2 + 1), dtype='f8')
+
+        if not isinstance(out, np.ndarray) or out.ndim != 3:
+            raise ValueError("out must be a 3D numpy array")
+        grid = out
+        codes = {np.dtype('f4'): 0, np.dtype('f8'): 1, np.dtype('c8'): 2, np.dtype('c16'): 3}
+        if grid.dtype not in codes or not grid.dtype.isnative:
+            raise TypeError("out must be of float32, float64, complex64 or complex128 "
+                            "in native byte order, not %s" % grid.dtype)
+        if not grid.flags.writeable or not grid.flags.aligned:
+            raise ValueError("out must be writeable and aligned")
+        dtype = codes[grid.dtype]
+
+        for a in range(3):
+            _nmesh[a] = nmesh[a]
+            _offset[a] = offset[a]
+            _shape[a] = grid.shape[a]
+            _strides[a] = grid.strides[a]
+            if _nmesh[a] < 1 or _offset[a] < 0 or _offset[a] + _shape[a] > _nmesh[a]:
+                raise ValueError("out of shape %s at offset %s does not fit in a mesh of %s"
+                                 % (grid.shape, tuple(offset), tuple(nmesh)))
+
+        # the largest n^2 is at the Nyquist frequency of all axes
+        cdef Py_ssize_t ntab = 1 + ((_nmesh[0] // 2) * (_nmesh[0] // 2)
+                                    + (_nmesh[1] // 2) * (_nmesh[1] // 2)
+                                    + (_nmesh[2] // 2) * (_nmesh[2] // 2))
+        cdef np.ndarray table = self._radial_table(2 * M_PI / boxsize, ntab, z, kind, nth)
+        if exponent != 1.:
+            table[1:] **= exponent
+
+        cdef double * ptable = <double*> table.data
+        cdef int mult = bool(multiply)
+        with nogil:
+            _paint_radial(grid.data, _shape, _strides, dtype, _nmesh, _offset,
+                          ptable, mult, nth)
+        return out
+
+    cdef np.ndarray _radial_table(self, double kf, Py_ssize_t size, double z, kind, int nthreads):
+        r"""
+        The function ``kind`` of :func:`paint` at :math:`k = k_f \sqrt{n}`,
+        for ``n`` in ``[0, size)``; the value at ``n = 0`` is not
+        evaluated and left to 0.
+        """
+        cdef Py_ssize_t i, b, m
+        cdef Py_ssize_t block = 4096
+        cdef int nfail = 0
+        cdef int nonlinear
+        cdef double zz = z
+        cdef spectra * psp
+        cdef char * slot
+        cdef char * slots
+        cdef np.ndarray k = kf * np.sqrt(np.arange(size, dtype='f8'))
+        cdef np.ndarray table = np.zeros(size, dtype='f8')
+        cdef double * pk = <double*> k.data
+        cdef double * pt = <double*> table.data
+        cdef np.ndarray lnk, tk, tk2, work
+        cdef double * x
+        cdef double * y
+        cdef double * y2
+        cdef Py_ssize_t n
+        cdef double v, h, c0, c1
+
+        if kind in ('pk', 'pklin'):
+            if (self.pt.has_pk_matter == _FALSE_):
+                raise ClassRuntimeError(
+                    "No power spectrum computed. You must add mPk to the list of outputs."
+                    )
+            self.engine.compute("spectra")
+            nonlinear = kind == 'pk' and self.nl.method != 0
+
+            # the first failure of each thread, as in Background._compute_for_z
+            slots = <char*> calloc(nthreads, sizeof(ErrorMsg))
+            with nogil, parallel(num_threads=nthreads):
+                psp = <spectra*> malloc(sizeof(spectra))
+                if psp != NULL:
+                    memcpy(psp, self.sp, sizeof(spectra))
+                slot = NULL
+                if slots != NULL:
+                    slot = &slots[threadid() * sizeof(ErrorMsg)]
+
+                for b in prange(1, size, block, schedule='dynamic'):
+                    m = min(block, size - b)
+                    if psp == NULL:
+                        nfail += 1
+                    elif _spectra_pk_many(self.ba, self.pm, psp, nonlinear, pk + b, 1, &zz, 0, m,
+                                          pt + b, 1) == _FAILURE_:
+                        nfail += 1
+                        _record_failure(slot, psp.error_message)
+
+                free(psp)
+
+            if nfail > 0:
+                _first_failure(slots, nthreads, self.sp.error_message)
+            free(slots)
+            if nfail > 0:
+                raise ClassRuntimeError(self.sp.error_message.decode())
+            return table
+
+        t = self.get_transfer([z], nthreads=1)[0, 0]
+        if kind not in t.dtype.names or kind == 'k':
+            raise ValueError("kind must be 'pk', 'pklin' or one of the transfer functions %s"
+                             % str(t.dtype.names[1:]))
+
+        lnk = np.ascontiguousarray(np.log(t['k']))
+        tk = np.ascontiguousarray(t[kind], dtype='f8')
+        n = lnk.shape[0]
+        if k[size-1] > t['k'][n-1] or (size > 1 and k[1] < t['k'][0]):
+            raise ValueError("k range [%g, %g] of the mesh is outside of the transfer functions, [%g, %g]"
+                             % (k[1], k[size-1], t['k'][0], t['k'][n-1]))
+
+        tk2 = np.empty(n, dtype='f8')
+        work = np.empty(n, dtype='f8')
+        x = <double*> lnk.data
+        y = <double*> tk.data
+        y2 = <double*> tk2.data
+        _spline_coefficients(x, y, n, 1, y2, <double*> work.data)
+
+        with nogil:
+            for i in prange(1, size, schedule='static', num_threads=nthreads):
+                v = log(pk[i])
+                b = _bisect(x, n, v)
+                h = x[b+1] - x[b]
+                c1 = (v - x[b]) / h
+                c0 = 1. - c1
+                pt[i] = (c0 * y[b] + c1 * y[b+1]
+                         + ((c0*c0*c0 - c0) * y2[b] + (c1*c1*c1 - c1) * y2[b+1]) * h * h / 6.)
+        return table
+
+
+    cdef int pk_at_k_and_z(self, double k, double z, int linear, double * pk) nogil:
+        r"""
+        Evaluate the power spectrum at ``k`` in :math:`h \mathrm{Mpc}^{-1}`
+        and redshift ``z``, in :math:`(\mathrm{Mpc}/h)^3`, without the GIL;
+        the power is nonlinear if enabled, unless ``linear`` is true.
+
+        This is part of the C-level API in ``classylss/binding.pxd``, for
+        calls from the parallel loops of other extensions. Returns
+        ``_FAILURE_`` if the evaluation failed, leaving the reason in
+        ``sp.error_message``.
+        """
+        if self.pt.has_pk_matter == _FALSE_:
+            strncpy(self.sp.error_message, "no power spectrum computed; add mPk to the outputs",
+                    sizeof(ErrorMsg))
+            return _FAILURE_
+
+        if not self.engine.ready.sp:
+            if self.engine.require("spectra", self.sp.error_message) == _FAILURE_:
+                return _FAILURE_
+
+        return self._pk_many(&k, 1, &z, 1, 1, linear, pk, 1)
 
     # Gives the pk for a given (k,z)
     cdef int pk(self, double k, double z, double * pk_ic, int lin, double * pk) except -1:
@@ -1360,6 +4452,7 @@ cdef class Spectra:
             because otherwise a segfault will occur
 
         """
+        self.engine.compute("spectra")
         if lin or self.nl.method == 0:
             if spectra_pk_at_k_and_z(self.ba,self.pm,self.sp,k,z,pk,pk_ic) == _FAILURE_:
                  raise ClassRuntimeError(self.sp.error_message.decode())
@@ -1368,7 +4461,7 @@ cdef class Spectra:
                  raise ClassRuntimeError(self.sp.error_message.decode())
         return 0
 
-    def get_pk(self, k, z):
+    def get_pk(self, k, z, out=None):
         r"""
         The primary power spectrum result (nonlinear if enabled) on ``k`` and
         ``z`` array.
@@ -1379,15 +4472,18 @@ cdef class Spectra:
           the wavenumber in units of :math:`h \mathrm{Mpc}^{-1}`
         z : float, array_like
           the redshift values
+        out : array_like, optional
+          an array to store the results in, of the broadcast shape of
+          ``k`` and ``z``
 
         Returns
         -------
         array like :
             the power spectrum in units of :math:`(\mathrm{Mpc}/h)^3`
         """
-        return self._get_pk(k, z, 0)
+        return self._get_pk(k, z, 0, out)
 
-    def get_pklin(self, k, z):
+    def get_pklin(self, k, z, out=None):
         r"""
         Linear power spectrum result (linear even if nonlinear is enabled)
         on ``k`` and ``z`` array.
@@ -1398,48 +4494,617 @@ cdef class Spectra:
           the wavenumber in units of :math:`h \mathrm{Mpc}^{-1}`
         z : float, array_like
           the redshift values
+        out : array_like, optional
+          an array to store the results in, of the broadcast shape of
+          ``k`` and ``z``
 
         Returns
         -------
         array like :
             the power spectrum in units of :math:`(\mathrm{Mpc}/h)^3`
         """
-        return self._get_pk(k, z, 1)
+        return self._get_pk(k, z, 1, out)
+
+    def as_ufunc(self, linear=False):
+        r"""
+        Return a numpy ufunc evaluating the power spectrum, as
+        :func:`get_pk` or :func:`get_pklin`.
+
+        The ufunc has float64 and float32 loops and supports the usual ufunc
+        arguments and broadcasting, e.g., for use with
+        ``dask.array.map_blocks``. It holds a reference to the engine, and
+        follows :func:`ClassEngine.update`. Points out of the range of the
+        CLASS tables give NaN.
+
+        Parameters
+        ----------
+        linear : bool, optional
+          whether to return the linear power spectrum even if the nonlinear
+          power is enabled
+
+        Returns
+        -------
+        numpy.ufunc :
+          the ufunc ``f(k, z)``, with ``k`` in :math:`h \mathrm{Mpc}^{-1}`
+          and the power in :math:`(\mathrm{Mpc}/h)^3`
+        """
+        if (self.pt.has_pk_matter == _FALSE_):
+            raise ClassRuntimeError(
+                "No power spectrum computed. You must add mPk to the list of outputs."
+                )
+        cdef _UFuncKernel kern = _UFuncKernel(self.engine, "spectra")
+        kern.kern.linear = bool(linear)
+        return _make_ufunc(kern, _ufunc_pk_loops, 2, "pklin" if linear else "pk",
+                           "the power spectrum as a function of k and z")
+
+    def get_pk_interpolator(self, linear=False, nthreads=None):
+        r"""
+        Return a bicubic spline of the power spectrum tables, which
+        evaluates :math:`P(k, z)` without going back to CLASS.
+
+        Parameters
+        ----------
+        linear : bool, optional
+          if True, use the linear power spectrum even if nonlinear is
+          enabled
+        nthreads : int, optional
+          the number of threads used to evaluate arrays
+
+        Returns
+        -------
+        PowerSpectrumInterpolator :
+            the interpolator, with :math:`P` in :math:`(\mathrm{Mpc}/h)^3`
+            and ``k`` in :math:`h \mathrm{Mpc}^{-1}`
+        """
+        return PowerSpectrumInterpolator(self, linear=linear, nthreads=nthreads)
+
+    cdef int _pk_many(self, const double * k, Py_ssize_t kstride,
+                      const double * z, Py_ssize_t zstride, Py_ssize_t size,
+                      int lin, double * out, Py_ssize_t ostride) nogil:
+        r"""
+        Evaluate the power spectrum on ``size`` pairs of ``k`` and ``z``,
+        stored every ``kstride`` and ``zstride`` values, without the GIL.
+
+        ``k`` is in :math:`h \mathrm{Mpc}^{-1}` and the results are written
+        to ``out`` in :math:`(\mathrm{Mpc}/h)^3`; the unit conversions are
+        done in the same pass as the CLASS calls. The loop stops at the
+        first failure and returns ``_FAILURE_``, leaving the reason in
+        ``sp.error_message``.
+        """
+        return _spectra_pk_many(self.ba, self.pm, self.sp, (not lin) and self.nl.method != 0,
+                                k, kstride, z, zstride, size, out, ostride)
 
-    def _get_pk(self, k, z, int linear):
+    def _get_pk(self, k, z, int linear, out=None):
 
         if (self.pt.has_pk_matter == _FALSE_):
             raise ClassRuntimeError(
                 "No power spectrum computed. You must add mPk to the list of outputs."
                 )
+        self.engine.compute("spectra")
+
+        cdef np.ndarray kc, zc, oc
+        cdef int status
+
+        # broadcast the inputs against each other; k stays in h/Mpc here and
+        # is converted to 1/Mpc inside the evaluation loop
+        it = _chunks([k, z, out])
+        with it:
+            for kc, zc, oc in it:
+                with nogil:
+                    status = self._pk_many(_chunk_data(kc), _chunk_stride(kc),
+                                           _chunk_data(zc), _chunk_stride(zc), kc.shape[0],
+                                           linear, _chunk_data(oc), _chunk_stride(oc))
+
+                if status == _FAILURE_:
+                    raise ClassRuntimeError(self.sp.error_message.decode())
+            out = it.operands[2]
+
+        return out
+
+cdef class PowerSpectrumInterpolator:
+    r"""
+    A bicubic spline of the matter power spectrum tables of CLASS in
+    :math:`\ln k` and :math:`\ln(1+z)`, which is evaluated without going
+    back to CLASS. Use :func:`Spectra.get_pk_interpolator` to build one.
+
+    The tables are exposed as read-only arrays (:attr:`ln_k`,
+    :attr:`ln_1pz` and :attr:`ln_pk`) and the evaluation functions can be
+    called without the GIL from other Cython modules; see
+    ``classylss/binding.pxd``.
+
+    Parameters
+    ----------
+    sp : Spectra
+      the spectra to tabulate
+    linear : bool, optional
+      whether to use the linear power spectrum, even if the nonlinear
+      power spectrum has been computed; by default, the nonlinear power
+      spectrum is used if enabled, as in :func:`Spectra.get_pk`
+    nthreads : int, optional
+      the number of threads used to evaluate arrays; if not given, the
+      value set by :func:`set_num_threads` is used
+    """
+    def __init__(self, Spectra sp, linear=False, nthreads=None):
+        cdef Py_ssize_t i, j
+        cdef int last_index = 0
+        cdef background * ba = sp.ba
+        cdef spectra * psp = sp.sp
+        cdef Py_ssize_t nk, nz
+        cdef double * data
+        cdef double lnh3 = 3 * log(ba.h)
+
+        if (sp.pt.has_pk_matter == _FALSE_):
+            raise ClassRuntimeError(
+                "No power spectrum computed. You must add mPk to the list of outputs."
+                )
+        sp.engine.compute("spectra")
+        nk = psp.ln_k_size
+        nz = psp.ln_tau_size
+        if psp.ic_ic_size[psp.index_md_scalars] != 1:
+            raise NotImplementedError("the interpolator only supports a single initial condition")
+
+        self.nthreads = 0 if nthreads is None else nthreads
+        self.linear = linear or sp.nl.method == 0
+        data = psp.ln_pk if self.linear else psp.ln_pk_nl
+
+        cdef double [::1] pvecback = np.empty(ba.bg_size, dtype=np.float64)
+        cdef double [::1] ln_1pz = np.empty(nz, dtype=np.float64)
+        cdef double [:, ::1] ln_pk = np.empty((nz, nk), dtype=np.float64)
+
+        # the tau table is increasing, so the redshifts are reversed
+        for i in range(nz):
+            if background_at_tau(ba, exp(psp.ln_tau[i]), ba.long_info, ba.inter_normal,
+                                 &last_index, &pvecback[0]) == _FAILURE_:
+                raise ClassRuntimeError(ba.error_message.decode())
+            ln_1pz[nz-1-i] = log(ba.a_today / pvecback[ba.index_bg_a])
+
+            # internally class uses Mpc ** 3
+            for j in range(nk):
+                ln_pk[nz-1-i, j] = data[i * nk + j] + lnh3
 
         # internally class uses 1 / Mpc
-        k = np.float64(k) * self.ba.h
-        z = np.float64(z)
+        ln_k = np.array([psp.ln_k[j] for j in range(nk)]) - log(ba.h)
+
+        self._setup(ln_k, np.asarray(ln_1pz), np.asarray(ln_pk))
+
+    cdef _setup(self, ln_k, ln_1pz, ln_pk):
+        r"""
+        Store the tables, of shape ``(nk,)``, ``(nz,)`` and ``(nz, nk)``,
+        and compute the spline coefficients.
+        """
+        cdef Py_ssize_t i, j
+
+        self.ln_k = np.array(ln_k, dtype=np.float64)
+        self.ln_1pz = np.array(ln_1pz, dtype=np.float64)
+        self.ln_pk = np.array(ln_pk, dtype=np.float64)
+        self.nk = self.ln_k.shape[0]
+        self.nz = self.ln_1pz.shape[0]
+
+        if self.nk < 3:
+            raise ValueError("the interpolator needs at least 3 wavenumbers")
+        if self.ln_pk.shape[0] != self.nz or self.ln_pk.shape[1] != self.nk:
+            raise ValueError("shape mismatch between the power spectrum and its grid")
+
+        cdef const double [::1] x = self.ln_k
+        cdef const double [::1] w = self.ln_1pz
+        cdef const double [:, ::1] y = self.ln_pk
+        cdef double [:, ::1] d2k = np.empty((self.nz, self.nk), dtype=np.float64)
+        cdef double [:, ::1] d2z = np.zeros((self.nz, self.nk), dtype=np.float64)
+        cdef double [:, ::1] d2kz = np.zeros((self.nz, self.nk), dtype=np.float64)
+        cdef double [::1] work = np.empty(max(self.nk, self.nz), dtype=np.float64)
+
+        # second derivatives in ln k, in ln(1+z), and the cross term; with
+        # fewer than 3 redshifts, the interpolation is linear in ln(1+z)
+        for j in range(self.nz):
+            _spline_coefficients(&x[0], &y[j, 0], self.nk, 1, &d2k[j, 0], &work[0])
+
+        if self.nz >= 3:
+            for i in range(self.nk):
+                _spline_coefficients(&w[0], &y[0, i], self.nz, self.nk, &d2z[0, i], &work[0])
+            for j in range(self.nz):
+                _spline_coefficients(&x[0], &d2z[j, 0], self.nk, 1, &d2kz[j, 0], &work[0])
+
+        self._set_tables(self.ln_k, self.ln_1pz, self.ln_pk,
+                         np.asarray(d2k), np.asarray(d2z), np.asarray(d2kz))
+
+    cdef _set_tables(self, np.ndarray ln_k, np.ndarray ln_1pz, np.ndarray ln_pk,
+                     np.ndarray d2k, np.ndarray d2z, np.ndarray d2kz):
+        r"""
+        Point the evaluation at the given C-contiguous tables and spline
+        coefficients, without copying them.
+        """
+        self.nk = ln_k.shape[0]
+        self.nz = ln_1pz.shape[0]
+        for table in [ln_pk, d2k, d2z, d2kz]:
+            if table.ndim != 2 or table.shape[0] != self.nz or table.shape[1] != self.nk:
+                raise ValueError("shape mismatch between the power spectrum and its grid")
+
+        self.ln_k = ln_k
+        self.ln_1pz = ln_1pz
+        self.ln_pk = ln_pk
+        self.d2k = d2k
+        self.d2z = d2z
+        self.d2kz = d2kz
+
+        self._ln_k = <double*> ln_k.data
+        self._ln_1pz = <double*> ln_1pz.data
+        self._ln_pk = <double*> ln_pk.data
+        self._d2k = <double*> d2k.data
+        self._d2z = <double*> d2z.data
+        self._d2kz = <double*> d2kz.data
+
+        for table in [self.ln_k, self.ln_1pz, self.ln_pk]:
+            if table.flags.writeable:
+                table.flags.writeable = False
+
+    property state:
+        r"""
+        A dict with the tables and the spline coefficients, from which
+        :func:`from_state` rebuilds the interpolator without CLASS.
+        """
+        def __get__(self):
+            return dict(linear=self.linear, ln_k=self.ln_k, ln_1pz=self.ln_1pz,
+                        ln_pk=self.ln_pk, d2k=self.d2k, d2z=self.d2z, d2kz=self.d2kz)
+
+    def __reduce__(self):
+        return (_rebuild_from_state, (PowerSpectrumInterpolator, self.state, self.nthreads))
+
+    @staticmethod
+    def from_state(dict state, nthreads=None):
+        r"""
+        Rebuild a :class:`PowerSpectrumInterpolator` from its :attr:`state`.
+
+        The tables are not copied, so they can be e.g. memory-mapped
+        read-only arrays shared between processes.
+        """
+        cdef PowerSpectrumInterpolator self = PowerSpectrumInterpolator.__new__(PowerSpectrumInterpolator)
+
+        self.nthreads = 0 if nthreads is None else nthreads
+        self.linear = state['linear']
+        tables = [np.ascontiguousarray(state[name], dtype=np.float64)
+                  for name in ['ln_k', 'ln_1pz', 'ln_pk', 'd2k', 'd2z', 'd2kz']]
+        if tables[0].shape[0] < 3:
+            raise ValueError("the interpolator needs at least 3 wavenumbers")
+        self._set_tables(*tables)
+        return self
+
+    property k_min:
+        r"""
+        The minimum ``k`` of the tables, in :math:`h \mathrm{Mpc}^{-1}`.
+        """
+        def __get__(self):
+            return np.exp(self.ln_k[0])
 
-        # Quantities for the isocurvature modes
-        cdef np.ndarray pk_ic = np.zeros(self.sp.ic_ic_size[self.sp.index_md_scalars], dtype='f8')
+    property k_max:
+        r"""
+        The maximum ``k`` of the tables, in :math:`h \mathrm{Mpc}^{-1}`.
+        """
+        def __get__(self):
+            return np.exp(self.ln_k[-1])
 
-        #generate a new output array of the correct shape by broadcasting input arrays together
-        out = np.empty(np.broadcast(k, z).shape, np.float64)
+    property z_min:
+        r"""
+        The minimum redshift of the tables.
+        """
+        def __get__(self):
+            return np.expm1(self.ln_1pz[0])
 
-        #generate the iterator over the input and output arrays, does the same thing as
-        # PyArray_MultiIterNew
+    property z_max:
+        r"""
+        The maximum redshift of the tables.
+        """
+        def __get__(self):
+            return np.expm1(self.ln_1pz[-1])
 
-        cdef np.broadcast it = np.broadcast(k, z, out)
+    cdef double evaluate(self, double k, double z) nogil:
+        r"""
+        The power spectrum in :math:`(\mathrm{Mpc}/h)^3` at ``k`` in
+        :math:`h \mathrm{Mpc}^{-1}` and ``z``; NaN outside of the tables.
+        """
+        cdef Py_ssize_t ik, iz, i0, i1
+        cdef double lnk = log(k)
+        cdef double w = log1p(z)
+        cdef double hk, ak, bk, ck, dk, hz, az, bz
+        cdef double f0, f1, g0, g1
+        cdef Py_ssize_t nk = self.nk
+        cdef Py_ssize_t nz = self.nz
+
+        if not ((lnk >= self._ln_k[0] - _SPLINE_RANGE_TOL_) & (lnk <= self._ln_k[nk-1] + _SPLINE_RANGE_TOL_)):
+            return NAN
+        if not ((w >= self._ln_1pz[0] - _SPLINE_RANGE_TOL_) & (w <= self._ln_1pz[nz-1] + _SPLINE_RANGE_TOL_)):
+            return NAN
+
+        # spline coefficients in ln k
+        ik = _bisect(self._ln_k, nk, lnk)
+        hk = self._ln_k[ik+1] - self._ln_k[ik]
+        bk = min(max((lnk - self._ln_k[ik]) / hk, 0.), 1.)
+        ak = 1. - bk
+        ck = (ak * ak * ak - ak) * hk * hk / 6.
+        dk = (bk * bk * bk - bk) * hk * hk / 6.
+
+        if nz == 1:
+            return exp(ak * self._ln_pk[ik] + bk * self._ln_pk[ik+1]
+                       + ck * self._d2k[ik] + dk * self._d2k[ik+1])
+
+        # values and second derivatives in ln(1+z) of the two bracketing rows
+        iz = _bisect(self._ln_1pz, nz, w)
+        i0 = iz * nk + ik
+        i1 = i0 + nk
+        f0 = ak * self._ln_pk[i0] + bk * self._ln_pk[i0+1] + ck * self._d2k[i0] + dk * self._d2k[i0+1]
+        f1 = ak * self._ln_pk[i1] + bk * self._ln_pk[i1+1] + ck * self._d2k[i1] + dk * self._d2k[i1+1]
+        g0 = ak * self._d2z[i0] + bk * self._d2z[i0+1] + ck * self._d2kz[i0] + dk * self._d2kz[i0+1]
+        g1 = ak * self._d2z[i1] + bk * self._d2z[i1+1] + ck * self._d2kz[i1] + dk * self._d2kz[i1+1]
+
+        hz = self._ln_1pz[iz+1] - self._ln_1pz[iz]
+        bz = min(max((w - self._ln_1pz[iz]) / hz, 0.), 1.)
+        az = 1. - bz
+        return exp(az * f0 + bz * f1 + ((az * az * az - az) * g0 + (bz * bz * bz - bz) * g1) * hz * hz / 6.)
+
+    cdef Py_ssize_t evaluate_many(self, const double * k, const double * z, Py_ssize_t size,
+                                  double * out, int nthreads) nogil:
+        r"""
+        Evaluate the power spectrum on ``size`` pairs of ``k`` and ``z``,
+        split over ``nthreads`` threads. Returns the number of points
+        outside of the tables, which are set to NaN.
+        """
+        return self._evaluate_many(k, 1, z, 1, size, out, 1, nthreads)
 
-        while np.PyArray_MultiIter_NOTDONE(it):
+    cdef Py_ssize_t _evaluate_many(self, const double * k, Py_ssize_t kstride,
+                                   const double * z, Py_ssize_t zstride, Py_ssize_t size,
+                                   double * out, Py_ssize_t ostride, int nthreads) nogil:
+        r"""
+        Same as :func:`evaluate_many`, with the values stored every
+        ``kstride``, ``zstride`` and ``ostride`` values.
+        """
+        cdef Py_ssize_t i
+        cdef Py_ssize_t nbad = 0
+        cdef double v
 
-                #PyArray_MultiIter_DATA is used to access the pointers the iterator points to
-                aval = (<double*>np.PyArray_MultiIter_DATA(it, 0))[0]
-                bval = (<double*>np.PyArray_MultiIter_DATA(it, 1))[0]
+        for i in prange(size, schedule='static', num_threads=nthreads):
+            v = self.evaluate(k[i*kstride], z[i*zstride])
+            out[i*ostride] = v
+            nbad += v != v
 
-                self.pk(aval, bval, <double*> pk_ic.data, linear, <double*>(np.PyArray_MultiIter_DATA(it, 2)))
+        return nbad
 
-                #PyArray_MultiIter_NEXT is used to advance the iterator
-                np.PyArray_MultiIter_NEXT(it)
+    def __call__(self, k, z, out=None):
+        r"""
+        Evaluate the power spectrum on ``k`` and ``z`` arrays.
 
-        # internally class uses Mpc ** 3
-        out[...] *= self.ba.h**3
+        Parameters
+        ----------
+        k : float, array_like
+          the wavenumber in units of :math:`h \mathrm{Mpc}^{-1}`
+        z : float, array_like
+          the redshift values
+        out : array_like, optional
+          an array to store the results in, of the broadcast shape of
+          ``k`` and ``z``
 
+        Returns
+        -------
+        array like :
+            the power spectrum in units of :math:`(\mathrm{Mpc}/h)^3`
+        """
+        cdef Py_ssize_t nbad = 0
+        cdef int nthreads = self.nthreads if self.nthreads > 0 else _num_threads
+        cdef np.ndarray kc, zc, oc
+
+        it = _chunks([k, z, out])
+        with it:
+            for kc, zc, oc in it:
+                with nogil:
+                    nbad += self._evaluate_many(_chunk_data(kc), _chunk_stride(kc),
+                                                _chunk_data(zc), _chunk_stride(zc), kc.shape[0],
+                                                _chunk_data(oc), _chunk_stride(oc), nthreads)
+            out = it.operands[2]
+
+        if nbad > 0:
+            raise ValueError("%d point(s) out of the range of the tables, k in [%g, %g] h/Mpc and z in [%g, %g]"
+                             % (nbad, self.k_min, self.k_max, self.z_min, self.z_max))
         return out
+
+# ---------------------------------------------------------------------------
+# numpy ufuncs bound to an engine
+# ---------------------------------------------------------------------------
+
+np.import_ufunc()
+
+cdef inline double _ufunc_load(const char * p, int single) nogil:
+    if single:
+        return (<const float *> p)[0]
+    return (<const double *> p)[0]
+
+cdef inline void _ufunc_store(char * p, double v, int single) nogil:
+    if single:
+        (<float *> p)[0] = <float> v
+    else:
+        (<double *> p)[0] = v
+
+ctypedef struct _ufunc_data:
+    background * ba
+    primordial * pm
+    spectra * sp
+    nonlinear * nl
+    int * ready
+    int column
+    int linear
+    double scale
+    PyObject * kernel
+
+cdef class _UFuncKernel:
+    r"""
+    The data of the inner loops of the ufuncs returned by the ``as_ufunc``
+    methods of the wrappers. The ufunc holds a reference to this object,
+    which keeps the engine alive.
+    """
+    cdef ClassEngine engine
+    cdef object level
+    cdef _ufunc_data kern
+    cdef void * data[2]
+    cdef bytes name
+    cdef bytes doc
+
+    def __init__(self, ClassEngine engine, level):
+        self.engine = engine
+        self.level = level
+        self.engine.compute(level)
+
+        self.kern.ba = &engine.ba
+        self.kern.pm = &engine.pm
+        self.kern.sp = &engine.sp
+        self.kern.nl = &engine.nl
+        if level == "background":
+            self.kern.ready = &engine.ready.ba
+        elif level == "primordial":
+            self.kern.ready = &engine.ready.pm
+        else:
+            self.kern.ready = &engine.ready.sp
+        self.kern.column = 0
+        self.kern.linear = 0
+        self.kern.scale = 1.
+        self.kern.kernel = <PyObject*> self
+        self.data[0] = &self.kern
+        self.data[1] = &self.kern
+
+    cdef int _ensure(self):
+        r"""
+        Recompute the module of the kernel, e.g., after
+        :func:`ClassEngine.update`; returns 0 if this fails.
+        """
+        try:
+            self.engine.compute(self.level)
+        except Exception:
+            return 0
+        return 1
+
+cdef inline int _ufunc_ready(_ufunc_data * kern) nogil:
+    r"""
+    Return 1 if the module of ``kern`` is computed, computing it if needed.
+    """
+    if kern.ready[0]:
+        return 1
+    with gil:
+        return (<_UFuncKernel> kern.kernel)._ensure()
+
+cdef void _ufunc_background(char ** args, np.npy_intp * dims, np.npy_intp * steps,
+                            void * data, int single) nogil:
+    cdef _ufunc_data * kern = <_ufunc_data *> data
+    cdef background * pba = kern.ba
+    cdef np.npy_intp i
+    cdef double tau, v
+    cdef int last_index = 0
+    cdef double * pvecback = NULL
+
+    if _ufunc_ready(kern):
+        pvecback = <double*> malloc(sizeof(double) * pba.bg_size)
+
+    for i in range(dims[0]):
+        v = NAN
+        if pvecback != NULL:
+            if (background_tau_of_z(pba, _ufunc_load(args[0] + i * steps[0], single), &tau) == _SUCCESS_ and
+                background_at_tau(pba, tau, pba.long_info, pba.inter_normal, &last_index, pvecback) == _SUCCESS_):
+                v = pvecback[kern.column] * kern.scale
+        _ufunc_store(args[1] + i * steps[1], v, single)
+
+    free(pvecback)
+
+cdef void _ufunc_pk(char ** args, np.npy_intp * dims, np.npy_intp * steps,
+                    void * data, int single) nogil:
+    cdef _ufunc_data * kern = <_ufunc_data *> data
+    cdef np.npy_intp i
+    cdef int status
+    cdef int nonlinear
+    cdef double h = kern.ba.h
+    cdef double k, z, v
+    cdef double * pk_ic = NULL
+
+    if _ufunc_ready(kern):
+        pk_ic = <double*> malloc(sizeof(double) * kern.sp.ic_ic_size[kern.sp.index_md_scalars])
+    nonlinear = (not kern.linear) and kern.nl.method != 0
+
+    for i in range(dims[0]):
+        v = NAN
+        if pk_ic != NULL:
+            k = _ufunc_load(args[0] + i * steps[0], single) * h
+            z = _ufunc_load(args[1] + i * steps[1], single)
+            if nonlinear:
+                status = spectra_pk_nl_at_k_and_z(kern.ba, kern.pm, kern.sp, k, z, &v)
+            else:
+                status = spectra_pk_at_k_and_z(kern.ba, kern.pm, kern.sp, k, z, &v, pk_ic)
+            # internally class uses Mpc ** 3
+            v = v * h * h * h if status == _SUCCESS_ else NAN
+        _ufunc_store(args[2] + i * steps[2], v, single)
+
+    free(pk_ic)
+
+cdef void _ufunc_pkprim(char ** args, np.npy_intp * dims, np.npy_intp * steps,
+                        void * data, int single) nogil:
+    cdef _ufunc_data * kern = <_ufunc_data *> data
+    cdef np.npy_intp i
+    cdef double h = kern.ba.h
+    cdef double k, v
+    cdef double * work = NULL
+
+    if _ufunc_ready(kern):
+        work = <double*> malloc(sizeof(double) * kern.pm.ic_ic_size[0])
+
+    for i in range(dims[0]):
+        v = NAN
+        if work != NULL:
+            k = _ufunc_load(args[0] + i * steps[0], single)
+            if _primordial_at_k(kern.pm, k * h, &v, work) == _FAILURE_:
+                v = NAN
+        _ufunc_store(args[1] + i * steps[1], v, single)
+
+    free(work)
+
+# the functions of the ufuncs, a double and a float loop for each kind
+cdef void _ufunc_background_d(char ** args, np.npy_intp * dims, np.npy_intp * steps, void * data) nogil:
+    _ufunc_background(args, dims, steps, data, 0)
+cdef void _ufunc_background_f(char ** args, np.npy_intp * dims, np.npy_intp * steps, void * data) nogil:
+    _ufunc_background(args, dims, steps, data, 1)
+cdef void _ufunc_pk_d(char ** args, np.npy_intp * dims, np.npy_intp * steps, void * data) nogil:
+    _ufunc_pk(args, dims, steps, data, 0)
+cdef void _ufunc_pk_f(char ** args, np.npy_intp * dims, np.npy_intp * steps, void * data) nogil:
+    _ufunc_pk(args, dims, steps, data, 1)
+cdef void _ufunc_pkprim_d(char ** args, np.npy_intp * dims, np.npy_intp * steps, void * data) nogil:
+    _ufunc_pkprim(args, dims, steps, data, 0)
+cdef void _ufunc_pkprim_f(char ** args, np.npy_intp * dims, np.npy_intp * steps, void * data) nogil:
+    _ufunc_pkprim(args, dims, steps, data, 1)
+
+cdef np.PyUFuncGenericFunction _ufunc_background_loops[2]
+cdef np.PyUFuncGenericFunction _ufunc_pk_loops[2]
+cdef np.PyUFuncGenericFunction _ufunc_pkprim_loops[2]
+_ufunc_background_loops[0] = _ufunc_background_d
+_ufunc_background_loops[1] = _ufunc_background_f
+_ufunc_pk_loops[0] = _ufunc_pk_d
+_ufunc_pk_loops[1] = _ufunc_pk_f
+_ufunc_pkprim_loops[0] = _ufunc_pkprim_d
+_ufunc_pkprim_loops[1] = _ufunc_pkprim_f
+
+cdef char _ufunc_types_1[4]
+cdef char _ufunc_types_2[6]
+_ufunc_types_1[:] = [np.NPY_DOUBLE, np.NPY_DOUBLE, np.NPY_FLOAT, np.NPY_FLOAT]
+_ufunc_types_2[:] = [np.NPY_DOUBLE, np.NPY_DOUBLE, np.NPY_DOUBLE,
+                     np.NPY_FLOAT, np.NPY_FLOAT, np.NPY_FLOAT]
+
+cdef object _make_ufunc(_UFuncKernel kern, np.PyUFuncGenericFunction * loops, int nin, name, doc):
+    r"""
+    Create a ufunc with ``nin`` inputs and one output, evaluating ``loops``
+    with the data of ``kern``.
+    """
+    cdef np.ufunc uf
+    cdef char * types = _ufunc_types_1 if nin == 1 else _ufunc_types_2
+
+    # numpy keeps the pointers to the data, name and doc
+    kern.name = name.encode()
+    kern.doc = doc.encode()
+
+    uf = np.PyUFunc_FromFuncAndData(loops, kern.data, types, 2,
+                                    nin, 1, np.PyUFunc_None, kern.name, kern.doc, 0)
+
+    # released by the ufunc when it is deallocated
+    Py_INCREF(kern)
+    uf.obj = <PyObject*> kern
+    return uf
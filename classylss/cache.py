@@ -0,0 +1,375 @@
+"""
+An on-disk cache of computed cosmologies.
+
+The tables of a computed :class:`~classylss.binding.ClassEngine` are
+stored in a single file, which is memory-mapped when loaded, so a cached
+cosmology is rebuilt in milliseconds and processes on the same node share
+one copy of the tables through the page cache.
+
+The background, the power spectra and the transfer functions are
+tabulated; of the thermodynamics, only the scalars (e.g. ``z_drag``) are
+stored, and the thermodynamics tables are out of scope.
+"""
+import os
+import tempfile
+import json
+import struct
+import hashlib
+import numpy
+
+_MAGIC = b'CLASSYLSS-TABLES'
+_FORMAT = 1
+_ALIGN = 64
+
+_BACKGROUND_SCALARS = ['h', 'Omega0_b', 'Omega0_cdm', 'Omega0_m', 'Omega0_r',
+                       'Omega0_lambda', 'Omega0_fld', 'Omega0_k', 'age0',
+                       'T0_cmb', 'Neff', 'a_max']
+_THERMO_SCALARS = ['z_drag', 'rs_drag', 'tau_reio', 'z_reio', 'z_rec',
+                   'rs_rec', 'theta_s']
+_SPECTRA_SCALARS = ['sigma8', 'A_s', 'n_s', 'k_pivot']
+
+# the options of TabulatedCosmology.from_engine and their defaults
+_OPTIONS = {'z_max': 100., 'size': 4096}
+
+def parameter_hash(pars, options=None):
+    """
+    Return a hash of the CLASS parameters ``pars``, of the tabulation
+    ``options`` of :func:`TabulatedCosmology.from_engine` if given, and of
+    the CLASS version, which identifies a cosmology in the cache.
+
+    The values are normalized as they are passed to CLASS, so e.g.
+    ``0.7`` and ``'0.7'`` give the same hash; the options are compared as
+    floats.
+    """
+    from .binding import val2str
+    from .version import class_version
+
+    normalized = sorted((str(key), val2str(pars[key])) for key in pars)
+    key = [class_version, normalized]
+    if options:
+        key.append(sorted((str(name), float(options[name])) for name in options))
+    s = json.dumps(key)
+    return hashlib.sha1(s.encode()).hexdigest()
+
+def _align(n):
+    return (n + _ALIGN - 1) // _ALIGN * _ALIGN
+
+class TabulatedCosmology(object):
+    """
+    A cosmology evaluated from the tables of a computed engine, without
+    CLASS.
+
+    Build one with :func:`from_engine` or :func:`load`; scalar quantities
+    of the background, thermodynamics and spectra (e.g. ``h``,
+    ``z_drag``, ``sigma8``) are available as attributes. The
+    thermodynamics tables are not tabulated.
+
+    Attributes
+    ----------
+    pars : dict
+        the CLASS parameters, as strings
+    background : FastBackground
+        the splines of the background quantities
+    pk_lin : PowerSpectrumInterpolator
+        the linear power spectrum, or None without 'mPk' output
+    pk : PowerSpectrumInterpolator
+        the nonlinear power spectrum if enabled, else equal to ``pk_lin``
+    """
+    def __init__(self, pars, scalars, background, pk_lin=None, pk=None, transfer=None):
+        self.pars = pars
+        self.scalars = scalars
+        self.background = background
+        self.pk_lin = pk_lin
+        self.pk = pk if pk is not None else pk_lin
+        self.transfer = transfer
+
+    def __getattr__(self, name):
+        scalars = self.__dict__.get('scalars', {})
+        if name in scalars:
+            return scalars[name]
+        raise AttributeError("'%s' object has no attribute '%s'" % (type(self).__name__, name))
+
+    @classmethod
+    def from_engine(cls, engine, z_max=_OPTIONS['z_max'], size=_OPTIONS['size']):
+        """
+        Tabulate a computed engine.
+
+        Parameters
+        ----------
+        engine : ClassEngine
+            the engine; the modules are computed up to spectra if needed
+        z_max : float, optional
+            the largest redshift of the background tables
+        size : int, optional
+            the number of nodes of the background tables
+        """
+        from .binding import Background, Thermo, Spectra, FastBackground, val2str
+
+        ba = Background(engine)
+        th = Thermo(engine)
+        sp = Spectra(engine)
+
+        scalars = {}
+        for name in _BACKGROUND_SCALARS:
+            scalars[name] = float(getattr(ba, name))
+        for name in _THERMO_SCALARS:
+            scalars[name] = float(getattr(th, name))
+
+        background = FastBackground(ba, z_max=min(z_max, ba.z_table[0]), size=size)
+
+        pk_lin = pk = transfer = None
+        if sp.has_pk_matter:
+            for name in _SPECTRA_SCALARS:
+                scalars[name] = float(getattr(sp, name))
+            pk_lin = sp.get_pk_interpolator(linear=True)
+            pk = sp.get_pk_interpolator(linear=False) if sp.nonlinear else pk_lin
+
+            tk = None
+            if sp.has_transfers:
+                # the nodes may round past the range of the spectra module
+                z = numpy.clip(numpy.expm1(pk_lin.ln_1pz), 0., sp.P_z_max)
+                tk = sp.get_transfer(z)
+
+            # the transfer of several initial conditions is not tabulated
+            if tk is not None and tk.shape[1] == 1:
+                names = list(tk.dtype.names)
+                data = numpy.array([tk[name][:, 0] for name in names]).transpose(1, 0, 2)
+                transfer = dict(ln_1pz=pk_lin.ln_1pz, names=names, data=data)
+
+        pars = dict((str(key), val2str(engine.pars[key])) for key in engine.pars)
+        return cls(pars, scalars, background, pk_lin, pk, transfer)
+
+    def get_pk(self, k, z):
+        r"""
+        The power spectrum in :math:`(\mathrm{Mpc}/h)^3` at ``k`` in
+        :math:`h \mathrm{Mpc}^{-1}`; see :func:`Spectra.get_pk`.
+        """
+        if self.pk is None:
+            raise ValueError("no power spectrum in the tables; add mPk to the outputs")
+        return self.pk(k, z)
+
+    def get_pklin(self, k, z):
+        r"""
+        The linear power spectrum in :math:`(\mathrm{Mpc}/h)^3`; see
+        :func:`Spectra.get_pklin`.
+        """
+        if self.pk_lin is None:
+            raise ValueError("no power spectrum in the tables; add mPk to the outputs")
+        return self.pk_lin(k, z)
+
+    def get_transfer(self, z):
+        r"""
+        The transfer functions at redshift ``z``, as a structured array like
+        :func:`Spectra.get_transfer`.
+
+        The transfer functions are stored at the redshifts of the power
+        spectrum tables and linearly interpolated in :math:`\ln(1+z)`
+        in between.
+        """
+        if self.transfer is None:
+            raise ValueError("no transfer functions in the tables")
+
+        x = self.transfer['ln_1pz']
+        data = self.transfer['data']
+        w = numpy.log1p(z)
+        if not (x[0] - 1e-6 <= w <= x[-1] + 1e-6):
+            raise ValueError("z=%g is out of the range of the tables [%g, %g]"
+                             % (z, numpy.expm1(x[0]), numpy.expm1(x[-1])))
+
+        if len(x) == 1:
+            values = data[0]
+        else:
+            i = min(max(numpy.searchsorted(x, w) - 1, 0), len(x) - 2)
+            b = (w - x[i]) / (x[i+1] - x[i])
+            values = (1 - b) * data[i] + b * data[i+1]
+
+        names = self.transfer['names']
+        out = numpy.empty(data.shape[-1], dtype=[(name, 'f8') for name in names])
+        for name, v in zip(names, values):
+            out[name] = v
+        return out
+
+    def _arrays(self):
+        arrays = {}
+        state = self.background.state
+        for name in ['table', 'table2', 'inverse', 'inverse2']:
+            arrays['background.' + name] = state[name]
+        for prefix, pk in [('pk_lin', self.pk_lin), ('pk', self.pk)]:
+            if pk is None or (prefix == 'pk' and pk is self.pk_lin): continue
+            state = pk.state
+            for name in ['ln_k', 'ln_1pz', 'ln_pk', 'd2k', 'd2z', 'd2kz']:
+                arrays[prefix + '.' + name] = state[name]
+        if self.transfer is not None:
+            arrays['transfer.ln_1pz'] = self.transfer['ln_1pz']
+            arrays['transfer.data'] = self.transfer['data']
+        return arrays
+
+    def tobytes(self):
+        """
+        Return the tables in the binary format of :func:`save`.
+        """
+        from .version import class_version
+
+        background = dict((key, value) for key, value in self.background.state.items()
+                          if not isinstance(value, numpy.ndarray))
+        meta = dict(format=_FORMAT, class_version=class_version,
+                    pars=self.pars, scalars=self.scalars, background=background,
+                    pk_lin=None if self.pk_lin is None else self.pk_lin.linear,
+                    pk=None if self.pk is None or self.pk is self.pk_lin else self.pk.linear,
+                    transfer=None if self.transfer is None else self.transfer['names'],
+                    arrays={})
+
+        arrays = self._arrays()
+        offset = 0
+        for name in sorted(arrays):
+            a = numpy.ascontiguousarray(arrays[name], dtype='<f8')
+            arrays[name] = a
+            meta['arrays'][name] = dict(shape=list(a.shape), offset=offset)
+            offset = _align(offset + a.nbytes)
+
+        header = json.dumps(meta).encode()
+        start = _align(len(_MAGIC) + 8 + len(header))
+
+        buf = bytearray(start + offset)
+        buf[:len(_MAGIC)] = _MAGIC
+        buf[len(_MAGIC):len(_MAGIC) + 8] = struct.pack('<Q', len(header))
+        buf[len(_MAGIC) + 8:len(_MAGIC) + 8 + len(header)] = header
+        for name in sorted(arrays):
+            i = start + meta['arrays'][name]['offset']
+            buf[i:i + arrays[name].nbytes] = arrays[name].tobytes()
+        return bytes(buf)
+
+    def save(self, filename):
+        """
+        Save the tables to ``filename``; the file is written under a
+        unique temporary name in the same directory and then renamed, so
+        concurrent readers never see a partial file, and concurrent
+        writers, e.g. threads, do not write to the same file.
+        """
+        dirname, basename = os.path.split(os.path.abspath(filename))
+        fd, tmp = tempfile.mkstemp(dir=dirname, prefix=basename + '.tmp-')
+        try:
+            with os.fdopen(fd, 'wb') as ff:
+                ff.write(self.tobytes())
+            # as a file created with open; mkstemp makes it private
+            os.chmod(tmp, 0o644)
+            os.rename(tmp, filename)
+        except BaseException:
+            os.remove(tmp)
+            raise
+
+    @classmethod
+    def frombytes(cls, buf, nthreads=None):
+        """
+        Rebuild the tables from the output of :func:`tobytes`, or any
+        buffer with the same content; the arrays are views of ``buf``.
+        """
+        from .binding import FastBackground, PowerSpectrumInterpolator
+        from .version import class_version
+
+        buf = numpy.frombuffer(buf, dtype='u1')
+        if buf[:len(_MAGIC)].tobytes() != _MAGIC:
+            raise ValueError("not a classylss table file")
+        size, = struct.unpack('<Q', buf[len(_MAGIC):len(_MAGIC) + 8].tobytes())
+        meta = json.loads(buf[len(_MAGIC) + 8:len(_MAGIC) + 8 + size].tobytes().decode())
+
+        if meta['format'] != _FORMAT:
+            raise ValueError("unsupported table file format %d" % meta['format'])
+        if meta['class_version'] != class_version:
+            raise ValueError("tables computed with CLASS %s, but using CLASS %s"
+                             % (meta['class_version'], class_version))
+
+        start = _align(len(_MAGIC) + 8 + size)
+
+        arrays = {}
+        for name, info in meta['arrays'].items():
+            shape = tuple(info['shape'])
+            nbytes = 8 * int(numpy.prod(shape))
+            offset = start + info['offset']
+            arrays[name] = buf[offset:offset + nbytes].view('<f8').reshape(shape)
+
+        def state(prefix):
+            return dict((name.split('.', 1)[1], value) for name, value in arrays.items()
+                        if name.startswith(prefix + '.'))
+
+        s = state('background')
+        s.update(meta['background'])
+        background = FastBackground.from_state(s, nthreads=nthreads)
+
+        pk_lin = pk = transfer = None
+        if meta['pk_lin'] is not None:
+            s = state('pk_lin')
+            s['linear'] = meta['pk_lin']
+            pk_lin = PowerSpectrumInterpolator.from_state(s, nthreads=nthreads)
+        if meta['pk'] is not None:
+            s = state('pk')
+            s['linear'] = meta['pk']
+            pk = PowerSpectrumInterpolator.from_state(s, nthreads=nthreads)
+        if meta['transfer'] is not None:
+            transfer = state('transfer')
+            transfer['names'] = meta['transfer']
+
+        return cls(meta['pars'], meta['scalars'], background, pk_lin, pk, transfer)
+
+    @classmethod
+    def load(cls, filename, nthreads=None):
+        """
+        Load tables saved by :func:`save`, memory-mapping the arrays
+        read-only.
+        """
+        try:
+            return cls.frombytes(numpy.memmap(filename, dtype='u1', mode='r'), nthreads=nthreads)
+        except ValueError as e:
+            raise ValueError("'%s': %s" % (filename, e))
+
+    def __reduce__(self):
+        # ship the tables in the compact binary format
+        return (_frombytes, (self.tobytes(),))
+
+def _frombytes(buf):
+    return TabulatedCosmology.frombytes(buf)
+
+class CosmologyCache(object):
+    """
+    A directory of tabulated cosmologies, keyed by :func:`parameter_hash`
+    of the parameters and of the tabulation options, so caches of
+    different options can share a directory.
+
+    Parameters
+    ----------
+    path : str
+        the directory of the cache; it is created if needed
+    **kwargs :
+        passed to :func:`TabulatedCosmology.from_engine` when a cosmology
+        is computed
+    """
+    def __init__(self, path, **kwargs):
+        unknown = set(kwargs) - set(_OPTIONS)
+        if unknown:
+            raise TypeError("unknown tabulation options: %s" % ', '.join(sorted(unknown)))
+        self.path = path
+        self.options = dict(_OPTIONS, **kwargs)
+        if not os.path.isdir(path):
+            os.makedirs(path)
+
+    def filename(self, pars):
+        """
+        The file of the cosmology ``pars`` in the cache.
+        """
+        return os.path.join(self.path, parameter_hash(pars, self.options) + '.tables')
+
+    def __contains__(self, pars):
+        return os.path.exists(self.filename(pars))
+
+    def get(self, pars, nthreads=None):
+        """
+        Return the :class:`TabulatedCosmology` of ``pars``, loading it from
+        the cache, or computing and saving it if it is not cached yet.
+        """
+        from .binding import ClassEngine
+
+        filename = self.filename(pars)
+        if not os.path.exists(filename):
+            engine = ClassEngine(pars)
+            TabulatedCosmology.from_engine(engine, **self.options).save(filename)
+        return TabulatedCosmology.load(filename, nthreads=nthreads)
@@ -12,7 +12,7 @@ DEF _FILENAMESIZE_ = 256
 DEF _LINE_LENGTH_MAX_ = 1024
 DEF _ERRORMSGSIZE_ = 2048
 
-cdef extern from "class.h":
+cdef extern from "class.h" nogil:
 
     ctypedef char FileArg[40]
 
@@ -32,6 +32,14 @@ cdef extern from "class.h":
         newtonian
         synchronous
 
+    cdef enum primordial_spectrum_type:
+        analytic_Pk
+        two_scales
+        inflation_V
+        inflation_H
+        inflation_V_end
+        external_Pk
+
     cdef struct precision:
         FileName hyrec_Alpha_inf_file;
         FileName hyrec_R_inf_file;
@@ -41,8 +49,14 @@ cdef extern from "class.h":
 
     cdef struct background:
         ErrorMsg error_message
+        short has_cdm
+        short has_ncdm
         short has_fld
         short has_lambda
+        short has_ur
+        short has_dcdm
+        short has_dr
+        short has_scf
         int bg_size
         int index_bg_a
         int index_bg_ang_distance
@@ -53,6 +67,7 @@ cdef extern from "class.h":
         int index_bg_H_prime
         int index_bg_D
         int index_bg_f
+        int index_bg_rs
         int index_bg_Omega_r
         int index_bg_Omega_m
         int index_bg_rho_g
@@ -65,10 +80,22 @@ cdef extern from "class.h":
         int index_bg_rho_crit
         int index_bg_rho_ncdm1
         int index_bg_p_ncdm1
+        int index_bg_pseudo_p_ncdm1
+        int index_bg_rho_dcdm
+        int index_bg_rho_dr
+        int index_bg_phi_scf
+        int index_bg_phi_prime_scf
+        int index_bg_V_scf
+        int index_bg_dV_scf
+        int index_bg_ddV_scf
+        int index_bg_rho_scf
+        int index_bg_p_scf
 
         int sgnK
+        short short_info
         short long_info
         short inter_normal
+        short inter_closeby
         double T_cmb
         double * T_ncdm
         double H0
@@ -95,13 +122,26 @@ cdef extern from "class.h":
         double cs2_fld
         double K
         int bt_size
+        double * tau_table
+        double * z_table
+        double * d2tau_dz2_table
+        double * background_table
 
     cdef struct thermo:
         ErrorMsg error_message
         int th_size
         int index_th_xe
+        int index_th_dkappa
+        int index_th_tau_d
+        int index_th_ddkappa
+        int index_th_exp_m_kappa
+        int index_th_g
+        int index_th_dg
         int index_th_Tb
+        int index_th_cb2
+        int index_th_rate
         short inter_normal
+        short inter_closeby
         double tau_reio
         double z_reio
         double z_rec
@@ -118,6 +158,8 @@ cdef extern from "class.h":
         double n_e
 
         int tt_size
+        double * z_table
+        double * thermodynamics_table
 
     cdef struct perturbs:
         ErrorMsg error_message
@@ -154,11 +196,22 @@ cdef extern from "class.h":
         int size_vector_perturbation_data[_MAX_NUMBER_OF_K_FILES_]
         int size_tensor_perturbation_data[_MAX_NUMBER_OF_K_FILES_]
 
+        int md_size
+        int * ic_size
+        int * tp_size
+        int * k_size
+        int tau_size
+
     cdef struct transfers:
         ErrorMsg error_message
+        int md_size
+        int * tp_size
+        int * l_size
+        int q_size
 
     cdef struct primordial:
         ErrorMsg error_message
+        primordial_spectrum_type primordial_spec_type
         double k_pivot
         double A_s
         double n_s
@@ -188,6 +241,10 @@ cdef extern from "class.h":
         double phi_max
 
         int lnk_size
+        double * lnk
+        int md_size
+        int * ic_size
+        int * ic_ic_size
     cdef struct spectra:
         ErrorMsg error_message
         int has_tt
@@ -225,6 +282,10 @@ cdef extern from "class.h":
         int * l_size
         int index_md_scalars
         double* ln_k
+        int ln_tau_size
+        double * ln_tau
+        double * ln_pk
+        double * ln_pk_nl
         double sigma8
         double alpha_II_2_20
         double alpha_RI_2_20
@@ -273,10 +334,13 @@ cdef extern from "class.h":
         int has_lensed_cls
         int l_lensed_max
         int l_unlensed_max
+        int l_size
         ErrorMsg error_message
 
     cdef struct nonlinear:
         int method
+        int k_size
+        int tau_size
         ErrorMsg error_message
 
     cdef struct file_content:
@@ -296,6 +360,7 @@ cdef extern from "class.h":
     void background_free(void*)
     void nonlinear_free(void*)
 
+    cdef int _SUCCESS_
     cdef int _FAILURE_
     cdef int _FALSE_
     cdef int _TRUE_
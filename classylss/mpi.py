@@ -0,0 +1,131 @@
+"""
+Share one computed cosmology between the ranks of an MPI job.
+
+Instead of every rank running CLASS, one rank computes the engine and the
+tables of :class:`~classylss.cache.TabulatedCosmology` are broadcast in
+their binary format. On each node, the tables are received into an MPI
+shared memory window, so the node holds a single copy of them, and every
+rank evaluates the background, power spectra and transfer functions from
+that copy. Requires ``mpi4py``.
+"""
+import weakref
+import numpy
+
+from .cache import TabulatedCosmology
+
+def tabulate(pars, comm=None, root=0, per_node=False, shared=True, nthreads=None, **kwargs):
+    """
+    Compute the cosmology ``pars`` on one rank and return its tables on
+    all ranks of ``comm``. This is collective.
+
+    Parameters
+    ----------
+    pars : dict or ClassEngine
+        the CLASS parameters, or a computed engine; only used on the
+        ranks that compute
+    comm : MPI.Comm, optional
+        the communicator; default is ``MPI.COMM_WORLD``
+    root : int, optional
+        the rank that computes the cosmology
+    per_node : bool, optional
+        if True, one rank per node computes the cosmology, and nothing is
+        sent between nodes; ``root`` is then ignored
+    shared : bool, optional
+        if True, the tables are stored in a shared memory window of each
+        node; if False or if the MPI library does not support it, every
+        rank holds its own copy
+    nthreads : int, optional
+        the number of threads of the evaluators of the tables
+    **kwargs :
+        passed to :func:`TabulatedCosmology.from_engine`
+
+    Returns
+    -------
+    tab : TabulatedCosmology
+        the tables; with ``shared``, the arrays are read-only views of the
+        window, which is freed with ``tab``. Freeing the window is
+        collective over the node, so ``tab`` should be released at the
+        same point on all ranks, and its arrays should not outlive it.
+    """
+    from mpi4py import MPI
+    from .binding import ClassEngine
+
+    if comm is None:
+        comm = MPI.COMM_WORLD
+
+    # the computing rank is the first rank of its node and of the leaders
+    key = 0 if comm.rank == root else comm.rank + 1
+    if per_node:
+        key = comm.rank
+    try:
+        node = comm.Split_type(MPI.COMM_TYPE_SHARED, key=key)
+    except NotImplementedError:
+        node = comm.Split(comm.rank, key=0)
+    leaders = comm.Split(0 if node.rank == 0 else MPI.UNDEFINED, key=key)
+
+    computes = node.rank == 0 and (per_node or comm.rank == root)
+
+    buf = error = None
+    if computes:
+        try:
+            engine = pars if isinstance(pars, ClassEngine) else ClassEngine(pars)
+            tab = TabulatedCosmology.from_engine(engine, **kwargs)
+            buf = numpy.frombuffer(bytearray(tab.tobytes()), dtype='u1')
+        except Exception as e:
+            error = "%s: %s" % (type(e).__name__, e)
+
+    # a failure is raised on all ranks instead of leaving them waiting
+    if per_node:
+        errors = [e for e in comm.allgather(error) if e is not None]
+        error = errors[0] if errors else None
+    else:
+        error = comm.bcast(error, root=root)
+    if error is not None:
+        raise RuntimeError("computing the cosmology failed: %s" % error)
+
+    nbytes = 0
+    if node.rank == 0:
+        if per_node:
+            nbytes = len(buf)
+        else:
+            nbytes = leaders.bcast(len(buf) if computes else None, root=0)
+    nbytes = node.bcast(nbytes, root=0)
+
+    win = None
+    if shared:
+        try:
+            win = MPI.Win.Allocate_shared(nbytes if node.rank == 0 else 0, 1, comm=node)
+        except (NotImplementedError, MPI.Exception):
+            win = None
+
+    if win is not None:
+        mem, itemsize = win.Shared_query(0)
+        data = numpy.ndarray(buffer=mem, dtype='u1', shape=(nbytes,))
+        # the stores of the first rank are made visible to the node by the
+        # synchronizations around the barrier
+        win.Lock_all(MPI.MODE_NOCHECK)
+        if node.rank == 0:
+            if computes:
+                data[...] = buf
+            if not per_node:
+                leaders.Bcast(data, root=0)
+        win.Sync()
+        node.Barrier()
+        win.Sync()
+        win.Unlock_all()
+    else:
+        data = buf if computes else numpy.empty(nbytes, dtype='u1')
+        if not per_node and node.rank == 0:
+            leaders.Bcast(data, root=0)
+        node.Bcast(data, root=0)
+
+    data.flags.writeable = False
+
+    if leaders != MPI.COMM_NULL:
+        leaders.Free()
+    node.Free()
+
+    tab = TabulatedCosmology.frombytes(data, nthreads=nthreads)
+    if win is not None:
+        tab._window = weakref.finalize(tab, win.Free)
+    return tab
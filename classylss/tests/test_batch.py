@@ -0,0 +1,70 @@
+from classylss.binding import *
+from classylss.batch import run_many
+import numpy
+import pytest
+
+def test_run_many():
+    k = numpy.logspace(-2, 0, 10)
+    pars = [{'output': 'mPk', 'h': h} for h in [0.6, 0.7, 0.8]]
+    pars.append({'output': 'mPk', 'Omega_b': -1.0})
+
+    outputs = {'pk' : lambda engine: Spectra(engine).get_pklin(k, 0.),
+               'h' : lambda engine: Background(engine).h}
+    results, errors = run_many(pars, outputs, nthreads=2)
+
+    assert len(results) == len(pars)
+    for p, r, e in zip(pars[:-1], results[:-1], errors[:-1]):
+        assert e is None
+        assert r['h'] == p['h']
+        numpy.testing.assert_allclose(r['pk'],
+                Spectra(ClassEngine(p)).get_pklin(k, 0.))
+
+    # a failure does not abort the batch
+    assert results[-1] is None
+    assert isinstance(errors[-1], ValueError)
+
+    with pytest.raises(TypeError):
+        run_many(pars, None)
+
+def test_unreviewed_globals():
+    from classylss.batch import unreviewed_globals
+    symbols = unreviewed_globals()
+    # recorded by the build of the CLASS library
+    assert symbols is None or all(len(s) == 2 for s in symbols)
+
+def test_derivatives():
+    from classylss.batch import derivatives
+    pars = {'output': 'mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0,
+            'h': 0.7, 'A_s': 2.1e-9, 'n_s': 0.96}
+    steps = {'h': 0.01, 'A_s': 2e-11, 'n_s': 0.01}
+    k = numpy.logspace(-2, 0, 10)
+    z = [0., 1.]
+
+    names, d = derivatives(pars, steps, z, k=k, linear=True, nthreads=2)
+    assert names == ['h', 'A_s', 'n_s']
+    assert d['pk'].shape == (3, 10, 2)
+    assert d['D_A'].shape == (3, 2)
+    assert d['H'].shape == (3, 2)
+
+    # P is proportional to A_s, and the background does not depend on it
+    numpy.testing.assert_allclose(d['pk'][1], d['fiducial']['pk'] / pars['A_s'], rtol=1e-4)
+    assert (d['H'][1] == 0).all() and (d['D_A'][1] == 0).all()
+    # H(z=0) = 100 h km/s/Mpc
+    numpy.testing.assert_allclose(d['H'][0, 0], 100., rtol=1e-4)
+    numpy.testing.assert_allclose(d['fiducial']['H'][0], 70., rtol=1e-4)
+
+    # the same as the differences of separate engines
+    # the same as the differences of separate engines, in units without h
+    def pk(**kw):
+        p = dict(pars, **kw)
+        h = p['h']
+        return Spectra(ClassEngine(p)).get_pklin(k[:, None] / h, numpy.array(z)[None, :]) / h ** 3
+    expected = (pk(n_s=0.97) - pk(n_s=0.95)) / 0.02
+    numpy.testing.assert_allclose(d['pk'][2], expected, rtol=1e-6)
+    expected = (pk(h=0.71) - pk(h=0.69)) / 0.02
+    numpy.testing.assert_allclose(d['pk'][0], expected, rtol=1e-6)
+
+    with pytest.raises(ValueError):
+        derivatives(pars, {'Omega_cdm': 0.01}, z)
+    with pytest.raises(ValueError):
+        derivatives(dict(pars, Omega_b=-1.), {'Omega_b': 0.01}, z)
@@ -1,4 +1,5 @@
 from classylss.binding import *
+import numpy
 import pytest
 
 @pytest.mark.parametrize("a_max", [1.0, 2.0])
@@ -55,3 +56,744 @@ def test_primordial(a_max):
     Pk = pm.get_pkprim([0., 0.1, 0.2])
 
     pr = pm.get_primordial()
+
+def test_sp_batched():
+    cosmo = ClassEngine({'output': 'mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0})
+    sp = Spectra(cosmo)
+    k = numpy.logspace(-3, 0, 16)
+    z = numpy.array([0., 0.5, 1.0])
+
+    pk = sp.get_pklin(k[None, :], z[:, None])
+    assert pk.shape == (3, 16)
+    for i in range(len(z)):
+        for j in range(len(k)):
+            assert pk[i, j] == sp.get_pklin(k[j], z[i])
+
+    # errors are reported once, after the loop
+    with pytest.raises(ClassRuntimeError):
+        sp.get_pklin([0.1, 100.0], 0.)
+
+def test_ba_threads():
+    cosmo = ClassEngine({'N_ncdm': 1, 'm_ncdm':[0.06]})
+    z = numpy.linspace(0., 10., 1001)
+    D1 = Background(cosmo, nthreads=1).comoving_distance(z)
+    D4 = Background(cosmo, nthreads=4).comoving_distance(z)
+    numpy.testing.assert_array_equal(D1, D4)
+
+    # failures in any thread are reported
+    with pytest.raises(ClassRuntimeError):
+        Background(cosmo, nthreads=4).comoving_distance([0.1, -0.5])
+
+    # with failures in all threads, the first one of the first thread is reported
+    with pytest.raises(ClassRuntimeError) as e:
+        Background(cosmo, nthreads=4).comoving_distance(-numpy.linspace(0.5, 1.0, 64))
+    assert "out of range: z=-5.000000e-01" in str(e.value)
+
+    with pytest.raises(ValueError):
+        set_num_threads(0)
+
+def test_ba_evaluate():
+    cosmo = ClassEngine({'N_ncdm': 1, 'm_ncdm':[0.06]})
+    ba = Background(cosmo)
+    z = numpy.array([[0.2, 0.3, 0.4]])
+
+    r = ba.evaluate(z, ['conf_distance', 'H', 'D', 'f'])
+    assert r.shape == z.shape
+    assert r.dtype.names == ('conf_distance', 'H', 'D', 'f')
+    numpy.testing.assert_array_equal(r['H'], ba.hubble_function(z))
+    numpy.testing.assert_array_equal(r['D'], ba.scale_independent_growth_factor(z))
+    numpy.testing.assert_array_equal(r['f'], ba.scale_independent_growth_rate(z))
+    numpy.testing.assert_array_equal(r['conf_distance'] * ba.h, ba.comoving_distance(z))
+
+    # all columns, scalar input
+    r = ba.evaluate(0.5)
+    assert r.shape == ()
+    assert 'rho_ncdm[0]' in r.dtype.names
+
+    with pytest.raises(ValueError):
+        ba.evaluate(0.5, ['not_a_column'])
+
+@pytest.mark.parametrize("nthreads", [1, 3])
+def test_ba_monotonic(nthreads):
+    cosmo = ClassEngine({'a_max': 2.0})
+    ba = Background(cosmo, nthreads=nthreads)
+    z = numpy.linspace(-0.4, 20., 1000)
+    index = [ba.columns['conf_distance'], ba.columns['H']]
+
+    ref = ba.compute_for_z(z, index, monotonic=False)
+    numpy.testing.assert_allclose(ba.compute_for_z(z, index, monotonic=True), ref, rtol=1e-12)
+    numpy.testing.assert_allclose(ba.compute_for_z(z[::-1], index)[::-1], ref, rtol=1e-12)
+
+    # forcing the sorted path on unsorted input is slower, but still correct
+    i = numpy.random.RandomState(42).permutation(len(z))
+    numpy.testing.assert_allclose(ba.compute_for_z(z[i], index, monotonic=True), ref[i], rtol=1e-12)
+
+@pytest.mark.parametrize("a_max", [1.0, 2.0])
+def test_fast_background(a_max):
+    cosmo = ClassEngine({'a_max':a_max, 'N_ncdm': 1, 'm_ncdm':[0.06]})
+    ba = Background(cosmo)
+    fb = FastBackground(ba, z_max=10.)
+    z = numpy.linspace(fb.z_min, 10., 257)
+
+    assert_allclose = numpy.testing.assert_allclose
+    assert_allclose(fb.comoving_distance(z), ba.comoving_distance(z), rtol=1e-6, atol=1e-6)
+    assert_allclose(fb.hubble_function(z), ba.hubble_function(z), rtol=1e-6)
+    assert_allclose(fb.efunc(z), ba.efunc(z), rtol=1e-6)
+    assert_allclose(fb.scale_independent_growth_factor(z), ba.scale_independent_growth_factor(z), rtol=1e-6)
+    assert_allclose(fb.scale_independent_growth_rate(z), ba.scale_independent_growth_rate(z), rtol=1e-6)
+    assert_allclose(fb.time(z), ba.time(z), rtol=1e-6)
+
+    # inverse mapping
+    assert_allclose(fb.z_of_comoving_distance(ba.comoving_distance(z)), z, rtol=1e-6, atol=1e-6)
+    assert fb.z_of_comoving_distance([[1000., 2000.]]).shape == (1, 2)
+
+    with pytest.raises(ValueError):
+        fb.comoving_distance(20.)
+
+def test_pk_interpolator():
+    cosmo = ClassEngine({'output': 'mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0})
+    sp = Spectra(cosmo)
+    pk = sp.get_pk_interpolator(linear=True)
+
+    assert pk.ln_pk.shape == (len(pk.ln_1pz), len(pk.ln_k))
+    assert not pk.ln_pk.flags.writeable
+    numpy.testing.assert_allclose(pk.z_min, 0., atol=1e-8)
+    numpy.testing.assert_allclose(pk.z_max, 10., rtol=1e-6)
+
+    k = numpy.logspace(-3, 0, 32)
+    z = numpy.array([0., 0.3, 1.0, 5.0])
+    numpy.testing.assert_allclose(pk(k[None, :], z[:, None]),
+                                  sp.get_pklin(k[None, :], z[:, None]), rtol=1e-3)
+
+    with pytest.raises(ValueError):
+        pk(0.1, 20.)
+
+    # both default to the nonlinear power spectrum, like get_pk
+    cosmo = ClassEngine({'output': 'mPk', 'non linear': 'halofit', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0})
+    sp = Spectra(cosmo)
+    assert not sp.get_pk_interpolator().linear
+    assert not PowerSpectrumInterpolator(sp).linear
+    assert PowerSpectrumInterpolator(sp, linear=True).linear
+
+def test_table_views():
+    cosmo = ClassEngine({'output': 'mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0})
+    ba = Background(cosmo)
+    th = Thermo(cosmo)
+    sp = Spectra(cosmo)
+
+    table = ba.background_table
+    assert table.shape == (len(ba.tau_table), len(ba.columns))
+    assert sorted(ba.columns.values()) == list(range(table.shape[1]))
+    assert not table.flags.writeable
+    assert not table.flags.owndata
+    numpy.testing.assert_allclose(table[-1, ba.columns['a']], ba.a_max)
+    numpy.testing.assert_allclose(ba.z_table[-1], 0., atol=1e-10)
+
+    assert th.thermodynamics_table.shape[0] == len(th.z_table)
+
+    ln_pk = sp.ln_pk
+    assert ln_pk.shape == (len(sp.ln_tau), len(sp.ln_k), 1)
+    numpy.testing.assert_allclose(numpy.exp(sp.ln_k[[0, -1]]) / ba.h,
+                                  [sp.P_k_min / 1.001, sp.P_k_max / 0.999])
+
+    # the modules are not freed under live views
+    with pytest.raises(ClassRuntimeError):
+        cosmo.update({'A_s': 2.2e-9})
+    with pytest.raises(ClassRuntimeError):
+        cosmo.release('spectra')
+    assert cosmo.level == 'spectra'
+    assert numpy.isfinite(ln_pk).all()
+
+    copy = numpy.array(ln_pk)
+    del ln_pk
+    cosmo.update({'A_s': 2.2e-9})
+    assert not numpy.allclose(sp.ln_pk, copy)
+
+    # the views keep the engine alive
+    ln_pk = sp.ln_pk
+    with pytest.raises(ClassRuntimeError):
+        cosmo.update({'h': 0.7})
+    del cosmo, ba, th, sp
+    assert numpy.isfinite(ln_pk).all()
+    assert numpy.isfinite(table).all()
+
+def test_update():
+    pars = {'output': 'mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0}
+    k = numpy.logspace(-3, 0, 20)
+
+    cosmo = ClassEngine(pars)
+    sp = Spectra(cosmo)
+    sp.get_pklin(k, 0.)
+    assert cosmo.level == 'spectra'
+
+    # only the primordial and later modules are recomputed
+    assert cosmo.update({'n_s': 0.95, 'A_s': 2.2e-9}) == 'primordial'
+    assert cosmo.level == 'spectra'
+    pars2 = dict(pars, n_s=0.95, A_s=2.2e-9)
+    ref = Spectra(ClassEngine(pars2))
+    numpy.testing.assert_allclose(sp.get_pklin(k, 0.), ref.get_pklin(k, 0.))
+    assert cosmo.pars == pars2
+
+    assert cosmo.update({'n_s': 0.95}) is None
+
+    # anything else recomputes everything
+    ba = Background(cosmo)
+    assert cosmo.update({'h': 0.7}) == 'input'
+    engine = ClassEngine(dict(pars2, h=0.7))
+    ref = Spectra(engine)
+    numpy.testing.assert_allclose(sp.get_pklin(k, 0.), ref.get_pklin(k, 0.))
+
+    # including the background of the existing wrappers
+    refba = Background(engine)
+    numpy.testing.assert_allclose(ba.rho_b(0.5), refba.rho_b(0.5))
+    numpy.testing.assert_allclose(ba.comoving_distance(0.5), refba.comoving_distance(0.5))
+    numpy.testing.assert_allclose(ba.Omega0_r, refba.Omega0_r)
+
+    # a parser failure leaves the engine untouched
+    with pytest.raises(ClassParserError):
+        cosmo.update({'n_s': 'abc'})
+    assert cosmo.pars['n_s'] == 0.95
+    numpy.testing.assert_allclose(sp.get_pklin(k, 0.), ref.get_pklin(k, 0.))
+
+def test_lazy():
+    cosmo = ClassEngine({'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0}, outputs=['mPk'])
+    assert cosmo.pars['output'] == 'mPk'
+    assert cosmo.level == 'input'
+
+    # input parameters do not need any module
+    sp = Spectra(cosmo)
+    th = Thermo(cosmo)
+    sp.n_s
+    sp.A_s
+    Perturbs(cosmo).gauge
+    assert cosmo.level == 'input'
+
+    th.z_drag
+    assert cosmo.level == 'thermodynamics'
+
+    sp.sigma8
+    assert cosmo.level == 'spectra'
+
+    cosmo.compute('lensing')
+    assert cosmo.level == 'lensing'
+
+    with pytest.raises(ValueError):
+        ClassEngine({'output': 'mPk'}, outputs=['mPk'])
+
+def test_pickle():
+    import pickle
+    cosmo = ClassEngine({'output': 'mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0})
+    ba = Background(cosmo, nthreads=2)
+    sp = Spectra(cosmo)
+    k = numpy.logspace(-2, 0, 10)
+    pk = sp.get_pklin(k, 0.)
+
+    # the modules of the engine are recomputed, before any query
+    cosmo2, ba2, sp2 = pickle.loads(pickle.dumps((cosmo, ba, sp)))
+    assert ba2.nthreads == 2
+    assert cosmo2 is not cosmo
+    assert cosmo2.level == 'spectra'
+    numpy.testing.assert_allclose(sp2.get_pklin(k, 0.), pk)
+    numpy.testing.assert_allclose(ba2.comoving_distance(1.), ba.comoving_distance(1.))
+
+    # the tables of the interpolators are shipped
+    fb = FastBackground(ba, z_max=10.)
+    pki = sp.get_pk_interpolator(linear=True)
+    fb2, pki2 = pickle.loads(pickle.dumps((fb, pki)))
+    numpy.testing.assert_array_equal(fb2.comoving_distance([0.5, 1.]), fb.comoving_distance([0.5, 1.]))
+    numpy.testing.assert_array_equal(pki2(k, 1.), pki(k, 1.))
+
+@pytest.mark.parametrize("nthreads", [1, 4])
+def test_sigma(nthreads):
+    cosmo = ClassEngine({'output': 'mPk', 'P_k_max_h/Mpc' : 100., "z_max_pk" : 10.0})
+    sp = Spectra(cosmo)
+    z = numpy.array([0., 0.5, 2.])
+
+    s8 = sp.sigma8_z(z, nthreads=nthreads)
+    assert s8.shape == z.shape
+    numpy.testing.assert_allclose(sp.sigma8_z(0.), sp.sigma8, rtol=1e-4)
+
+    R = numpy.logspace(0, 1.5, 50)
+    sigma, dlns = sp.sigma(R, z, derivative=True, nthreads=nthreads)
+    assert sigma.shape == (50, 3)
+    numpy.testing.assert_allclose(sp.sigma(8., z), s8, rtol=2e-3)
+    numpy.testing.assert_allclose(dlns[1:-1], numpy.gradient(numpy.log(sigma), numpy.log(R), axis=0)[1:-1], rtol=1e-2)
+
+    with pytest.raises(ValueError):
+        sp.sigma(8., 20.)
+    with pytest.raises(ValueError):
+        sp.sigma8_z(z, nthreads=0)
+
+    # the message of a single failing redshift is reported
+    zbad = numpy.array([20., 30., 40., 50.])
+    messages = []
+    for zi in zbad:
+        with pytest.raises(ClassRuntimeError) as e:
+            sp.sigma8_z([zi], nthreads=1)
+        messages.append(str(e.value))
+    with pytest.raises(ClassRuntimeError) as e:
+        sp.sigma8_z(zbad, nthreads=nthreads)
+    assert str(e.value) in messages
+
+    # the cached spline follows the update of the engine
+    cosmo.update({'A_s': 2 * sp.A_s})
+    numpy.testing.assert_allclose(sp.sigma(R, z), 2 ** 0.5 * sigma, rtol=1e-6)
+
+@pytest.mark.parametrize("nthreads", [1, 4])
+def test_transfer_batched(nthreads):
+    cosmo = ClassEngine({'output': 'dTk vTk mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0})
+    sp = Spectra(cosmo)
+    z = numpy.array([0., 1., 2., 5.])
+
+    tk = sp.get_transfer(z, nthreads=nthreads)
+    assert tk.shape[:2] == (4, 1)
+    for i in range(len(z)):
+        numpy.testing.assert_array_equal(tk[i, 0], sp.get_transfer(z[i]))
+
+    assert sp.get_transfer(z.reshape(2, 2), output_format='camb').shape[:3] == (2, 2, 1)
+
+    with pytest.raises(ClassRuntimeError):
+        sp.get_transfer([0., 20.], nthreads=nthreads)
+
+    # the message of a single failing redshift is reported
+    zbad = numpy.array([20., 30., 40., 50.])
+    messages = []
+    for zi in zbad:
+        with pytest.raises(ClassRuntimeError) as e:
+            sp.get_transfer([zi], nthreads=1)
+        messages.append(str(e.value))
+    with pytest.raises(ClassRuntimeError) as e:
+        sp.get_transfer(zbad, nthreads=nthreads)
+    assert str(e.value) in messages
+
+    with pytest.raises(ValueError):
+        sp.get_transfer(z, nthreads=0)
+
+def test_out():
+    cosmo = ClassEngine({'output': 'mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0})
+    ba = Background(cosmo)
+    sp = Spectra(cosmo)
+    pm = Primordial(cosmo)
+
+    z = numpy.linspace(0., 5., 20)
+    D = ba.comoving_distance(z)
+
+    # results are written into the buffer that is passed in
+    out = numpy.empty_like(z)
+    r = ba.comoving_distance(z, out=out)
+    assert r is out
+    numpy.testing.assert_array_equal(out, D)
+
+    # non-contiguous and float32 inputs are accepted
+    numpy.testing.assert_array_equal(ba.comoving_distance(numpy.repeat(z, 2)[::2]), D)
+    numpy.testing.assert_allclose(ba.comoving_distance(z.astype('f4')), D, rtol=1e-6)
+
+    # strided output and multiple columns
+    out = numpy.empty((20, 2))
+    ba.comoving_distance(z, out=out[:, 1])
+    numpy.testing.assert_array_equal(out[:, 1], D)
+    assert ba.compute_for_z(z, [0, 1]).shape == (20, 2)
+
+    k = numpy.logspace(-2, 0, 20)
+    out = numpy.empty((20, 20))
+    sp.get_pk(k[:, None], z[None, :], out=out)
+    numpy.testing.assert_array_equal(out, sp.get_pk(k[:, None], z[None, :]))
+
+    out = numpy.empty_like(k)
+    pm.get_pkprim(k, out=out)
+    numpy.testing.assert_array_equal(out, pm.get_pkprim(k))
+
+    out = numpy.empty(3)
+    sp.sigma8_z([0., 1., 2.], out=out)
+    numpy.testing.assert_array_equal(out, sp.sigma8_z([0., 1., 2.]))
+
+    out = numpy.empty((20, len(ba.T_ncdm(0.))))
+    ba.T_ncdm(z, out=out)
+    numpy.testing.assert_array_equal(out, ba.T_ncdm(z))
+
+    # the derived quantities are computed in out too
+    ba = Background(ClassEngine({'N_ncdm': 1, 'm_ncdm': 0.06, 'Omega_k': 0.01}))
+    for name in ['rho_m', 'rho_r', 'rho_ncdm', 'rho_k', 'rho_tot', 'rho_fld', 'rho_lambda',
+                 'p_ncdm', 'Omega_r', 'Omega_m', 'Omega_g', 'Omega_b', 'Omega_cdm', 'Omega_k',
+                 'Omega_ur', 'Omega_ncdm', 'Omega_fld', 'Omega_lambda', 'Omega_pncdm',
+                 'efunc_prime', 'comoving_transverse_distance', 'T_cmb']:
+        f = getattr(ba, name)
+        out = numpy.empty_like(z)
+        assert f(z, out=out) is out
+        numpy.testing.assert_allclose(out, f(z), rtol=1e-12, err_msg=name)
+
+        # in place, the redshifts are read before they are overwritten
+        zz = z.copy()
+        assert f(zz, out=zz) is zz
+        numpy.testing.assert_allclose(zz, out, rtol=1e-12, err_msg=name)
+    numpy.testing.assert_allclose(ba.T_ncdm(z)[:, 0], ba.T0_ncdm * (1 + z), rtol=1e-12)
+    numpy.testing.assert_allclose(ba.Omega_k(0.), 0.01, rtol=1e-3)
+
+    # output of the wrong shape
+    with pytest.raises(ValueError):
+        ba.comoving_distance(z, out=numpy.empty(10))
+
+def test_ufunc():
+    cosmo = ClassEngine({'output': 'mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0})
+    ba = Background(cosmo)
+    sp = Spectra(cosmo)
+    pm = Primordial(cosmo)
+
+    z = numpy.linspace(0., 5., 20)
+    k = numpy.logspace(-2, 0, 10)
+
+    H = ba.as_ufunc('H')
+    assert isinstance(H, numpy.ufunc)
+    numpy.testing.assert_allclose(H(z), ba.hubble_function(z))
+    assert H(z.astype('f4')).dtype == numpy.float32
+
+    pk = sp.as_ufunc(linear=True)
+    assert pk.nin == 2
+    numpy.testing.assert_allclose(pk(k[:, None], z[None, :3]), sp.get_pklin(k[:, None], z[None, :3]))
+    numpy.testing.assert_allclose(sp.as_ufunc()(k, 0.5), sp.get_pk(k, 0.5))
+    numpy.testing.assert_allclose(pm.as_ufunc()(k), pm.get_pkprim(k))
+
+    # where= and out= come from numpy
+    out = numpy.zeros_like(z)
+    H(z, out=out, where=z > 1)
+    numpy.testing.assert_array_equal(out[z <= 1], 0.)
+    numpy.testing.assert_allclose(out[z > 1], ba.hubble_function(z[z > 1]))
+
+    # failures are NaN
+    assert numpy.isnan(pk(1., 20.))
+
+    # the ufuncs follow the updates of the engine
+    cosmo.update({'A_s': 4.2e-9})
+    numpy.testing.assert_allclose(pk(k, 0.), sp.get_pklin(k, 0.))
+
+    with pytest.raises(ValueError):
+        ba.as_ufunc('no such column')
+
+def test_engine_threads():
+    import pickle
+    from classylss import binding
+    pars = {'output': 'mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0}
+    k = numpy.logspace(-2, 0, 10)
+
+    pk1 = Spectra(ClassEngine(pars, nthreads=1)).get_pklin(k, 0.)
+    cosmo = ClassEngine(pars, nthreads=2)
+    assert cosmo.nthreads == 2
+    numpy.testing.assert_allclose(Spectra(cosmo).get_pklin(k, 0.), pk1, rtol=1e-10)
+    assert pickle.loads(pickle.dumps(cosmo)).nthreads == 2
+    assert ClassEngine(pars).nthreads == 0
+    assert isinstance(binding.openmp, bool)
+
+    with pytest.raises(ValueError):
+        ClassEngine(pars, nthreads=0)
+
+def test_instrumentation():
+    cosmo = ClassEngine({'output': 'mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0})
+    events = []
+    cosmo.trace = lambda module, event, info: events.append((module, event))
+
+    Spectra(cosmo).sigma8
+    for module in ['background', 'thermodynamics', 'perturb', 'primordial', 'spectra']:
+        assert cosmo.timings[module]['wall'] >= 0
+        assert cosmo.timings[module]['cpu'] >= 0
+        assert (module, 'start') in events and (module, 'end') in events
+
+    ba = cosmo.memory['background']
+    assert ba['background_table'] > 0
+    assert cosmo.memory['perturb']['sources'] > cosmo.memory['spectra']['ln_pk']
+
+    # the entries of the recomputed modules are replaced
+    spectra, background = cosmo.timings['spectra'], cosmo.timings['background']
+    del events[:]
+    cosmo.update({'A_s': 2.2e-9})
+    assert cosmo.timings['spectra'] is not spectra
+    assert cosmo.timings['background'] is background
+    assert ('primordial', 'start') in events and ('spectra', 'end') in events
+    assert ('background', 'start') not in events
+
+def test_trace_raises():
+    cosmo = ClassEngine({'output': 'mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0})
+    def trace(module, event, info):
+        if (module, event) == ('perturb', 'end'):
+            raise KeyError(module)
+    cosmo.trace = trace
+
+    with pytest.raises(KeyError):
+        cosmo.compute('spectra')
+
+    # the modules computed before the exception are kept
+    assert cosmo.level == 'perturb'
+    cosmo.trace = None
+    assert Spectra(cosmo).sigma8 > 0
+    assert 'spectra' in cosmo.timings
+
+def test_release():
+    cosmo = ClassEngine({'output': 'mPk dTk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0})
+    sp = Spectra(cosmo)
+    ba = Background(cosmo)
+    k = numpy.logspace(-2, 0, 10)
+    pk = sp.get_pk(k, 0.5)
+
+    assert cosmo.release(['perturb', 'transfer', 'lensing']) == ['perturb', 'transfer']
+    assert cosmo.released == ['perturb', 'transfer']
+    assert 'perturb' not in cosmo.memory
+
+    # the spectra and background tables are still valid
+    numpy.testing.assert_array_equal(sp.get_pk(k, 0.5), pk)
+    ba.comoving_distance(1.)
+
+    # a primordial update cannot reuse the released perturbations
+    assert cosmo.update({'A_s': 2.2e-9}) == 'input'
+    assert cosmo.released == []
+    ref = Spectra(ClassEngine(dict(cosmo.pars)))
+    numpy.testing.assert_allclose(sp.get_pk(k, 0.5), ref.get_pk(k, 0.5), rtol=1e-10)
+
+    # the modules depending on the released ones fail cleanly
+    cosmo.release(retain=['background'])
+    assert 'spectra' in cosmo.released
+    with pytest.raises(ClassRuntimeError):
+        sp.get_pk(k, 0.5)
+    with pytest.raises(ClassRuntimeError):
+        Thermo(cosmo).z_drag
+
+    # recomputed from scratch after an update of the background
+    cosmo.update({'h': 0.7})
+    assert cosmo.released == []
+    sp.get_pk(k, 0.5)
+
+    with pytest.raises(ValueError):
+        cosmo.release('background')
+    with pytest.raises(ValueError):
+        cosmo.release()
+
+def test_parameter_template():
+    import pickle
+    pars = {'output': 'mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0, 'h': 0.67, 'n_s': 0.96}
+    template = ParameterTemplate(pars, ['h', 'n_s'])
+    k = numpy.logspace(-2, 0, 10)
+
+    engine = template.engine({'h': 0.7})
+    assert engine.pars['h'] == 0.7 and engine.pars['n_s'] == 0.96
+    ref = ClassEngine(dict(pars, h=0.7))
+    assert engine.parameter_file == ref.parameter_file
+    numpy.testing.assert_array_equal(Spectra(engine).get_pk(k, 0.), Spectra(ref).get_pk(k, 0.))
+
+    # the engines of a template are independent
+    e1 = template.engine({'n_s': 0.9}, nthreads=1)
+    e2 = template.engine({'n_s': 1.0})
+    assert Spectra(e1).get_pk(1., 0.) < Spectra(e2).get_pk(1., 0.)
+
+    template = pickle.loads(pickle.dumps(template))
+    assert template.varying == ('h', 'n_s')
+
+    with pytest.raises(ValueError):
+        template.engine({'Omega_cdm': 0.3})
+
+    # no default: validated on the first engine
+    template = ParameterTemplate(pars, ['Omega_cdm'])
+    with pytest.raises(ValueError):
+        template.engine()
+    template.engine({'Omega_cdm': 0.25})
+
+    with pytest.raises(ClassParserError):
+        ParameterTemplate(dict(pars, Omega_cdm='abc'), ['h'])
+
+def test_pkprim_analytic():
+    cosmo = ClassEngine({'output': 'dTk mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0, 'alpha_s': -0.01})
+    pm = Primordial(cosmo)
+    sp = Spectra(cosmo)
+
+    # the closed form of the analytic spectrum
+    k = numpy.logspace(-3, 1, 50)
+    L = numpy.log(k / sp.k_pivot)
+    expected = sp.A_s * numpy.exp((sp.n_s - 1) * L + 0.5 * -0.01 * L**2)
+    numpy.testing.assert_allclose(pm.get_pkprim(k), expected, rtol=1e-12)
+    numpy.testing.assert_allclose(pm.as_ufunc()(k), expected, rtol=1e-12)
+    assert pm.get_pkprim(0.) == 0.
+
+    # fused with a transfer function
+    t = sp.get_transfer(0.)
+    kt = t[t.dtype.names[0]]
+    pk = pm.get_pkprim(kt, tk=t['d_tot'])
+    numpy.testing.assert_allclose(pk, 2 * numpy.pi**2 * t['d_tot']**2 * pm.get_pkprim(kt) / kt**3)
+    numpy.testing.assert_allclose(pk[1:-1], sp.get_pklin(kt[1:-1], 0.), rtol=1e-2)
+
+    with pytest.raises(ClassRuntimeError):
+        pm.get_pkprim(1e10)
+
+@pytest.mark.parametrize('nthreads', [1, 4])
+def test_paint(nthreads):
+    cosmo = ClassEngine({'output': 'dTk mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0})
+    sp = Spectra(cosmo)
+    nmesh, boxsize = (16, 12, 10), 100.
+
+    kx, ky, kz = [2 * numpy.pi / boxsize * numpy.fft.fftfreq(n, 1. / n) for n in nmesh]
+    kz = abs(kz[:nmesh[2] // 2 + 1])
+    k = (kx[:, None, None] ** 2 + ky[None, :, None] ** 2 + kz[None, None, :] ** 2) ** 0.5
+    k[0, 0, 0] = 1.
+    expected = sp.get_pklin(k, 1.)
+    expected[0, 0, 0] = 0
+
+    pk = sp.paint(nmesh, boxsize, z=1., nthreads=nthreads)
+    assert pk.shape == (16, 12, 6)
+    numpy.testing.assert_allclose(pk, expected, rtol=1e-10)
+
+    # complex slab of a full grid, multiplied in place
+    out = numpy.ones((4, 12, 10), dtype='c8')
+    sp.paint(nmesh, boxsize, z=1., out=out, offset=(8, 0, 0), multiply=True,
+             exponent=0.5, nthreads=nthreads)
+    assert (out.imag == 0).all()
+    numpy.testing.assert_allclose(out.real[:, :, :6], expected[8:12] ** 0.5, rtol=1e-5)
+
+    # transfer functions are interpolated in k
+    tk = sp.paint(nmesh, boxsize, kind='d_tot', nthreads=nthreads)
+    t = sp.get_transfer(0.)
+    assert tk[0, 0, 0] == 0
+    numpy.testing.assert_allclose(tk.ravel()[1:], numpy.interp(k.ravel()[1:], t['k'], t['d_tot']), rtol=1e-2)
+
+    with pytest.raises(ValueError):
+        sp.paint(nmesh, boxsize, out=numpy.zeros((4, 12, 10)), offset=(14, 0, 0))
+    with pytest.raises(ValueError):
+        sp.paint(nmesh, boxsize, kind='nonexistent')
+    with pytest.raises(TypeError):
+        sp.paint(nmesh, boxsize, out=numpy.zeros((16, 12, 6), dtype='i4'))
+    with pytest.raises(ValueError):
+        sp.paint(nmesh, boxsize, nthreads=0)
+    with pytest.raises(ClassRuntimeError):
+        sp.paint(nmesh, boxsize, z=20., nthreads=nthreads)
+
+@pytest.mark.parametrize('nthreads', [1, 4])
+def test_thermo_vectorized(nthreads):
+    cosmo = ClassEngine({'output': 'mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0})
+    th = Thermo(cosmo, nthreads=nthreads)
+
+    z = numpy.linspace(0., 3000., 1001)
+    data = th.evaluate(z)
+    assert data.shape == z.shape
+    numpy.testing.assert_array_equal(data['x_e'], th.x_e(z))
+    numpy.testing.assert_array_equal(data['Tb'], th.T_b(z))
+
+    # sorted and shuffled redshifts give the same result
+    i = numpy.random.permutation(len(z))
+    numpy.testing.assert_allclose(th.x_e(z[i]), th.x_e(z)[i], rtol=1e-12)
+    numpy.testing.assert_allclose(th.compute_for_z(z, th.columns['g'], monotonic=False),
+                                  th.compute_for_z(z, th.columns['g'], monotonic=True), rtol=1e-12)
+
+    # fully ionized today, recombined after z_rec, and peak visibility at z_rec
+    xe = th.x_e([0., 1000., 1e4])
+    assert xe[0] > 1. and xe[1] < 0.2 and xe[2] > 1.
+    g = th.visibility(z)
+    assert abs(z[g.argmax()] - th.z_rec) < 10.
+    numpy.testing.assert_allclose(th.sound_horizon(th.z_drag), th.rs_drag, rtol=1e-2)
+
+    out = numpy.empty((2, len(z)), dtype='f4')[0]
+    th.T_b(z, out=out)
+    numpy.testing.assert_allclose(out, th.T_b(z), rtol=1e-6)
+
+    # above the table, the baryons are coupled to the photons
+    zhigh = float(th.z_table[-1]) * numpy.array([1., 1.5, 2.])
+    numpy.testing.assert_allclose(th.T_b(zhigh), Background(cosmo).T_cmb(zhigh), rtol=1e-3)
+    assert numpy.isfinite(th.evaluate(zhigh)['kappa_prime']).all()
+
+    with pytest.raises(ValueError):
+        th.evaluate(z, ['nonexistent'])
+    with pytest.raises(ClassRuntimeError):
+        th.x_e(-1.)
+
+def test_compute_async():
+    from concurrent.futures import CancelledError, ThreadPoolExecutor
+    pars = {'output': 'mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0}
+
+    cosmo = ClassEngine(pars)
+    progress = []
+    future = cosmo.compute_async('spectra', progress=lambda *args: progress.append(args))
+    assert future.result() is cosmo
+    assert cosmo.level == 'spectra'
+    assert future.completed == future.modules
+    assert progress[-1] == ('spectra', len(future.modules), len(future.modules))
+    assert not future.cancelled()
+
+    # cancelled from the progress report, between two modules
+    import threading
+    cosmo = ClassEngine(pars)
+    futures = []
+    submitted = threading.Event()
+    def cancel(module, i, n):
+        submitted.wait()
+        if module == 'background': futures[0].cancel()
+    with ThreadPoolExecutor(1) as executor:
+        futures.append(cosmo.compute_async('spectra', executor=executor, progress=cancel))
+        submitted.set()
+        with pytest.raises(CancelledError):
+            futures[0].result()
+    assert futures[0].cancelled()
+    assert futures[0].completed == ['background']
+    assert cosmo.level == 'background'
+
+    # the engine can still be computed afterwards
+    assert Spectra(cosmo).sigma8 > 0
+
+    # the callbacks can query the modules that are ready, but not update
+    cosmo = ClassEngine(pars)
+    distances = []
+    def query(module, i, n):
+        if module == 'background':
+            distances.append(Background(cosmo).comoving_distance(1.))
+        if module == 'perturb':
+            cosmo.update({'h': 0.7})
+    future = cosmo.compute_async('spectra', progress=query)
+    with pytest.raises(ClassRuntimeError):
+        future.result(timeout=60)
+    assert distances[0] > 0
+    assert cosmo.level == 'perturb'
+
+    with pytest.raises(ValueError):
+        cosmo.compute_async('nonexistent')
+
+def test_float32_results():
+    from classylss import binding
+    cosmo = ClassEngine({'output': 'mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0})
+    ba = Background(cosmo)
+    fb = FastBackground(ba, z_max=10.)
+    th = Thermo(cosmo)
+    sp = Spectra(cosmo)
+    pk = sp.get_pk_interpolator()
+
+    z = numpy.linspace(0., 5., 1001)
+    z32 = z.astype('f4')
+    k32 = numpy.logspace(-2, 0, 1001).astype('f4')
+
+    # by default, the results are in double precision
+    assert not binding.get_float32_results()
+    assert ba.comoving_distance(z32).dtype == numpy.float64
+    assert ba.evaluate(z32, ['H'])['H'].dtype == numpy.float64
+
+    binding.set_float32_results(True)
+    try:
+        # single precision inputs give single precision results, computed in double
+        for f32, f64 in [(ba.comoving_distance(z32), ba.comoving_distance(z32.astype('f8'))),
+                         (fb.comoving_distance(z32), fb.comoving_distance(z32.astype('f8'))),
+                         (fb.efunc(z32[::2]), fb.efunc(z32[::2].astype('f8'))),
+                         (fb.z_of_comoving_distance(ba.comoving_distance(z32)), z32),
+                         (sp.get_pklin(k32, 1.), sp.get_pklin(k32.astype('f8'), 1.)),
+                         (pk(k32, 1.), pk(k32.astype('f8'), 1.)),
+                         (ba.evaluate(z32, ['H', 'D'])['D'], ba.scale_independent_growth_factor(z)),
+                         (th.evaluate(z32)['x_e'], th.x_e(z32.astype('f8')))]:
+            assert f32.dtype == numpy.float32
+            numpy.testing.assert_allclose(f32, f64, rtol=1e-5, atol=1e-5)
+
+        # mixed with double precision arrays, the results are in double precision
+        assert sp.get_pklin(k32, numpy.ones(1001)).dtype == numpy.float64
+        assert ba.comoving_distance([0., 1.]).dtype == numpy.float64
+        assert ba.compute_for_z(z, [0, 1]).dtype == numpy.float64
+    finally:
+        binding.set_float32_results(False)
+
+    out = numpy.empty(len(z) * 2, dtype='f4')[::2]
+    fb.comoving_distance(z, out=out)
+    numpy.testing.assert_allclose(out, fb.comoving_distance(z), rtol=1e-6)
+    out = numpy.empty((2, 1001), dtype='f8')
+    pk(k32, numpy.array([[0.], [1.]]), out=out)
+    numpy.testing.assert_allclose(out[1], pk(k32, 1.), rtol=1e-6)
+    out = numpy.empty((len(z), 2), dtype='f4')
+    ba.compute_for_z(z, [ba.columns['H'], ba.columns['D']], out=out)
+    numpy.testing.assert_allclose(out[:, 1], ba.scale_independent_growth_factor(z), rtol=1e-6)
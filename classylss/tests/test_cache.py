@@ -0,0 +1,64 @@
+from classylss.binding import *
+from classylss.cache import CosmologyCache, TabulatedCosmology, parameter_hash
+import numpy
+import pytest
+
+def test_parameter_hash():
+    assert parameter_hash({'h': 0.7}) == parameter_hash({'h': '0.7'})
+    assert parameter_hash({'h': 0.7}) != parameter_hash({'h': 0.71})
+    assert parameter_hash({'m_ncdm': [0.06]}) == parameter_hash({'m_ncdm': '0.06'})
+    assert parameter_hash({'h': 0.7}, {'z_max': 10}) == parameter_hash({'h': 0.7}, {'z_max': 10.})
+    assert parameter_hash({'h': 0.7}, {'z_max': 10.}) != parameter_hash({'h': 0.7}, {'z_max': 20.})
+
+def test_cache(tmpdir):
+    pars = {'output': 'dTk vTk mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0}
+    cache = CosmologyCache(str(tmpdir), z_max=10.)
+    assert pars not in cache
+
+    tab = cache.get(pars)
+    assert pars in cache
+    # no temporary file is left behind
+    assert tmpdir.listdir() == [tmpdir.join(parameter_hash(pars, cache.options) + '.tables')]
+
+    engine = ClassEngine(pars)
+    ba = Background(engine)
+    sp = Spectra(engine)
+
+    # reloaded from the memory-mapped file
+    tab2 = cache.get(pars)
+    assert not tab2.background.table.flags.writeable
+    assert tab2.pars == tab.pars
+
+    z = numpy.linspace(0., 8., 20)
+    k = numpy.logspace(-2, 0, 10)
+    for t in [tab, tab2]:
+        numpy.testing.assert_allclose(t.background.comoving_distance(z), ba.comoving_distance(z), rtol=1e-6)
+        numpy.testing.assert_allclose(t.get_pklin(k, 1.), sp.get_pklin(k, 1.), rtol=1e-3)
+        assert t.sigma8 == sp.sigma8
+        assert t.z_drag == Thermo(engine).z_drag
+
+    numpy.testing.assert_allclose(tab2.get_transfer(0.)['d_tot'], sp.get_transfer(0.)['d_tot'])
+    with pytest.raises(ValueError):
+        tab2.get_transfer(20.)
+
+    # a cache of other options does not share the file
+    cache2 = CosmologyCache(str(tmpdir), z_max=5.)
+    assert pars not in cache2
+    assert cache2.get(pars).background.z_max < tab.background.z_max
+    assert CosmologyCache(str(tmpdir), z_max=10, size=4096).filename(pars) == cache.filename(pars)
+    with pytest.raises(TypeError):
+        CosmologyCache(str(tmpdir), zmax=5.)
+
+def test_pickle_tables():
+    import pickle
+    pars = {'output': 'mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0}
+    tab = TabulatedCosmology.from_engine(ClassEngine(pars), z_max=10.)
+    assert tab.transfer is None
+
+    tab2 = pickle.loads(pickle.dumps(tab))
+    assert tab2.scalars == tab.scalars
+    k = numpy.logspace(-2, 0, 10)
+    numpy.testing.assert_array_equal(tab2.get_pklin(k, 0.5), tab.get_pklin(k, 0.5))
+
+    tab3 = TabulatedCosmology.frombytes(tab.tobytes())
+    numpy.testing.assert_array_equal(tab3.background.time([0., 1.]), tab.background.time([0., 1.]))
@@ -0,0 +1,33 @@
+from classylss.binding import *
+import gc
+import numpy
+import pytest
+
+MPI = pytest.importorskip('mpi4py.MPI')
+from classylss.mpi import tabulate
+
+@pytest.mark.parametrize('per_node', [False, True])
+@pytest.mark.parametrize('shared', [False, True])
+def test_tabulate(per_node, shared):
+    comm = MPI.COMM_WORLD
+    pars = {'output': 'dTk vTk mPk', 'P_k_max_h/Mpc' : 20., "z_max_pk" : 10.0}
+    tab = tabulate(pars, comm=comm, root=comm.size - 1, per_node=per_node, shared=shared, z_max=10.)
+
+    engine = ClassEngine(pars)
+    z = numpy.linspace(0., 8., 20)
+    k = numpy.logspace(-2, 0, 10)
+    numpy.testing.assert_allclose(tab.background.comoving_distance(z),
+                                  Background(engine).comoving_distance(z), rtol=1e-6)
+    numpy.testing.assert_allclose(tab.get_pklin(k, 1.), Spectra(engine).get_pklin(k, 1.), rtol=1e-3)
+    numpy.testing.assert_allclose(tab.get_transfer(0.)['d_tot'], Spectra(engine).get_transfer(0.)['d_tot'])
+    assert not tab.background.table.flags.writeable
+
+    # the window is freed with the tables
+    window = getattr(tab, '_window', None)
+    del tab
+    gc.collect()
+    assert window is None or not window.alive
+
+def test_tabulate_failure():
+    with pytest.raises(RuntimeError):
+        tabulate({'Omega_cdm': -1.}, comm=MPI.COMM_WORLD)
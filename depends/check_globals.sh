@@ -0,0 +1,42 @@
+#!/bin/sh -e
+
+# Check the writable global and static data symbols of libclass.a.
+#
+# classylss computes independent ClassEngine objects from several threads
+# at once (see classylss/batch.py); any symbol found here is shared by all
+# engines. The symbols that were reviewed and found safe to share are
+# listed in globals.reviewed, one "object symbol" pair per line, followed
+# by the reason; the others are printed and the check fails.
+#
+# `make install` runs this check on every build and records the
+# unreviewed symbols in data/globals.unreviewed (the optional third
+# argument); classylss.batch then computes the engines one at a time unless
+# that list is empty. `make check-globals` only runs the check.
+
+# also stop on errors when run as `sh check_globals.sh`
+set -e
+
+LIB="${1:-_inst/lib/libclass.a}"
+REVIEWED="${2:-$(dirname "$0")/globals.reviewed}"
+OUT="$3"
+trap 'rm -f globals.nm globals.found globals.known globals.unreviewed' EXIT
+
+# B/b: zero-initialized data, D/d: initialized data, C: common symbols;
+# read-only data (R/r) and code are safe to share. nm runs on its own, so
+# that its failure stops the script before OUT is written.
+nm -A "$LIB" > globals.nm
+awk '$(NF-1) ~ /^[BbDdC]$/ { n = split($1, f, ":"); print f[n-1], $NF }' globals.nm \
+    | sort -u > globals.found
+
+grep -v '^#' "$REVIEWED" | awk 'NF >= 2 { print $1, $2 }' | sort -u > globals.known
+
+comm -23 globals.found globals.known > globals.unreviewed
+if [ -n "$OUT" ]; then
+    cp globals.unreviewed "$OUT"
+fi
+
+if grep . globals.unreviewed; then
+    echo "the symbols above are not reviewed in $REVIEWED" >&2
+    exit 1
+fi
+echo "no unreviewed writable globals in $LIB"
@@ -3,4 +3,5 @@
 BASEDIR="$1"
 
 cd $BASEDIR/depends;
-make install CLASS_VERSION=$2 DEST=$3
+make install CLASS_VERSION=$2 DEST=$3 OPENMP=${4:-1} \
+    MARCH="$5" MTUNE="$6" LTO=${7:-0}
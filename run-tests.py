@@ -5,6 +5,16 @@ import sys; sys.path.pop(0)
 from runtests import Tester
 import os.path
 
+if '--bench' in sys.argv:
+    # the benchmarks run against the installed classylss, and the results
+    # are saved with the version for comparisons
+    import pytest
+    sys.argv.remove('--bench')
+    basedir = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'benchmarks')
+    args = [basedir, '--benchmark-only', '--benchmark-autosave',
+            '--benchmark-storage=%s' % os.path.join(basedir, '.results')]
+    sys.exit(pytest.main(args + sys.argv[1:]))
+
 tester = Tester(os.path.abspath(__file__), "classylss")
 
 tester.main(sys.argv[1:])
@@ -29,13 +29,27 @@ def find_version(path, name='version'):
 
 CLASS_VERSION = find_version("classylss/version.py", name='class_version')
 
+# build CLASS and the extension with OpenMP; set CLASSYLSS_OPENMP=0 to
+# disable, e.g. for compilers without OpenMP support
+OPENMP = os.environ.get('CLASSYLSS_OPENMP', '1') not in ('0', 'no', 'off', 'false')
+
+# target a specific CPU, e.g. CLASSYLSS_MARCH=native or x86-64-v3; the
+# binary then does not run on older CPUs. CLASSYLSS_MTUNE only tunes the
+# scheduling and keeps the default instruction set, for portable builds.
+MARCH = os.environ.get('CLASSYLSS_MARCH', '')
+MTUNE = os.environ.get('CLASSYLSS_MTUNE', '')
+
+# link-time optimization across libclass.a and the extension (gcc)
+LTO = os.environ.get('CLASSYLSS_LTO', '0') not in ('0', 'no', 'off', 'false')
+
 def build_CLASS(prefix):
     """
     Function to dowwnload CLASS from github and and build the library
     """
     # latest class version and download link
-    args = (package_basedir, package_basedir, CLASS_VERSION, os.path.abspath(prefix))
-    command = 'sh %s/depends/install_class.sh %s %s %s' %args
+    args = (package_basedir, package_basedir, CLASS_VERSION, os.path.abspath(prefix), int(OPENMP),
+            MARCH, MTUNE, int(LTO))
+    command = 'sh %s/depends/install_class.sh %s %s %s %d "%s" "%s" %d' %args
 
     ret = os.system(command)
     if ret != 0:
@@ -98,6 +112,10 @@ class custom_build_ext(build_ext):
         shutil.rmtree(os.path.join(self.build_lib, 'classylss', 'data'), ignore_errors=True)
         shutil.copytree(os.path.join(self.build_temp, 'data'), os.path.join(self.build_lib, 'classylss', 'data'))
 
+        # and the CLASS headers, for the extensions that cimport classylss.binding
+        shutil.rmtree(os.path.join(self.build_lib, 'classylss', 'include'), ignore_errors=True)
+        shutil.copytree(os.path.join(self.build_temp, 'include'), os.path.join(self.build_lib, 'classylss', 'include'))
+
         build_ext.run(self)
 
 class custom_sdist(sdist):
@@ -135,8 +153,24 @@ def classy_extension_config():
     # the configuration for GCL python extension
     config = {}
     config['name'] = 'classylss.binding'
+    # CLASS is compiled with OpenMP (see depends/class.cfg), and the
+    # vectorized accessors use prange; both link to the same runtime
     config['extra_link_args'] = ['-g', '-fPIC']
     config['extra_compile_args'] = []
+    if OPENMP:
+        config['extra_link_args'].append('-fopenmp')
+        config['extra_compile_args'].append('-fopenmp')
+    if MARCH:
+        config['extra_compile_args'].append('-march=%s' % MARCH)
+    if MTUNE:
+        config['extra_compile_args'].append('-mtune=%s' % MTUNE)
+    if LTO:
+        # the optimization level of the link-time code generation; the
+        # other options, e.g. -ffast-math of CLASS, are recorded per object
+        config['extra_compile_args'].append('-flto')
+        config['extra_link_args'] += ['-flto', '-O3']
+        if MARCH:
+            config['extra_link_args'].append('-march=%s' % MARCH)
     # important or get a symbol not found error, because class is
     # compiled with c++?
     config['language'] = 'c'
@@ -158,7 +192,9 @@ if __name__ == '__main__':
           license='GPL3',
           url="http://github.com/nickhand/classylss",
           install_requires=['numpy', 'cython', 'six'],
-          extras_require={'tests': ['runtests', 'astropy', 'scipy']},
+          extras_require={'tests': ['runtests', 'astropy', 'scipy'],
+                          'bench': ['runtests', 'pytest-benchmark'],
+                          'mpi': ['mpi4py']},
           ext_modules = cythonize([
                         Extension(**classy_extension_config())
           ]),
@@ -169,5 +205,6 @@ if __name__ == '__main__':
               'build_ext': custom_build_ext,
               'clean': custom_clean
           },
-         packages=['classylss', 'classylss.tests']
+         packages=['classylss', 'classylss.tests'],
+         package_data={'classylss': ['*.pxd']}
     )